@@ -6,11 +6,6 @@
 
 using namespace TachometerOptical_Namespace;
 
-// #######################################################################
-// Define macros:
-
-#define _2PI          6.2831853       // 2*pi
-
 // ########################################################################
 // Initialize static variables:
 
@@ -18,44 +13,63 @@ TachometerOptical* TachometerOptical::_instances[3] = {nullptr};
 
 TimerControl* TachometerOptical::_TIMER = nullptr;
 
-uint16_t TachometerOptical::_MAX = 0;
-
-uint16_t TachometerOptical::_MIN = 0;
-
-float TachometerOptical::_FILTER_FRQ = 0;
+TachometerOptical::EdgeSinkPtr TachometerOptical::_edgeSink = nullptr;
+void* TachometerOptical::_edgeSinkContext = nullptr;
 
-float TachometerOptical::_UPDATE_FRQ = 0;
-
-float TachometerOptical::_alpha = 0;
+TachometerOptical_Core::FilterConfigStructure TachometerOptical::_config = TachometerOptical_Core::makeFilterConfig(0, 0, 0, 0);
 
 volatile uint32_t TachometerOptical::_T = 0;
 
 float TachometerOptical::ValuesStructure::sharedRPM = 0;	
 
-std::string TachometerOptical::errorMessage = "";
+TachometerOptical::ErrorCode TachometerOptical::sharedErrorCode = TachometerOptical::ErrorCode::NONE;
 
 // ##########################################################################
 // General function definitions:
 
  void TachometerOptical_Namespace::_calcInput_CH1(void)
 {
-  unsigned long tNow = TachometerOptical::_TIMER->micros();
-  TachometerOptical::_instances[0]->_period = (uint32_t)(tNow - TachometerOptical::_instances[0]->_startPeriod);
-  TachometerOptical::_instances[0]->_startPeriod = tNow;
+  TachometerOptical::_instances[0]->_edgeHandler(TachometerOptical::_TIMER->micros());
 }
 
  void TachometerOptical_Namespace::_calcInput_CH2(void)
 {
-  unsigned long tNow = TachometerOptical::_TIMER->micros();
-  TachometerOptical::_instances[1]->_period = (uint32_t)(tNow - TachometerOptical::_instances[1]->_startPeriod);
-  TachometerOptical::_instances[1]->_startPeriod = tNow;
+  TachometerOptical::_instances[1]->_edgeHandler(TachometerOptical::_TIMER->micros());
 }
 
  void TachometerOptical_Namespace::_calcInput_CH3(void)
 {
-  unsigned long tNow = TachometerOptical::_TIMER->micros();
-  TachometerOptical::_instances[2]->_period = (uint32_t)(tNow - TachometerOptical::_instances[2]->_startPeriod);
-  TachometerOptical::_instances[2]->_startPeriod = tNow;
+  TachometerOptical::_instances[2]->_edgeHandler(TachometerOptical::_TIMER->micros());
+}
+
+ void TachometerOptical_Namespace::_stallInput_CH1(void)
+{
+  TachometerOptical::_instances[0]->_stallHandler();
+}
+
+ void TachometerOptical_Namespace::_stallInput_CH2(void)
+{
+  TachometerOptical::_instances[1]->_stallHandler();
+}
+
+ void TachometerOptical_Namespace::_stallInput_CH3(void)
+{
+  TachometerOptical::_instances[2]->_stallHandler();
+}
+
+ void TachometerOptical_Namespace::_pwmInput_CH1(void)
+{
+  TachometerOptical::_instances[0]->_pwmHandler();
+}
+
+ void TachometerOptical_Namespace::_pwmInput_CH2(void)
+{
+  TachometerOptical::_instances[1]->_pwmHandler();
+}
+
+ void TachometerOptical_Namespace::_pwmInput_CH3(void)
+{
+  TachometerOptical::_instances[2]->_pwmHandler();
 }
 
 // ##########################################################################
@@ -68,16 +82,118 @@ TachometerOptical::TachometerOptical()
     parameters.GPIO_PORT = nullptr;
     parameters.GPIO_PIN = GPIO_PIN_0;
     parameters.CHANNEL_NUM = 0;	
+    parameters.EDGE_MODE = EdgeMode::RISING;
+    parameters.PWM_TIMER = nullptr;
+    parameters.INTERRUPT_PRIORITY = 0;
 
     EXTI_Callback = nullptr;
+    STALL_Callback = nullptr;
+    PWM_Callback = nullptr;
+
+    errorCode = ErrorCode::NONE;
 
     value.rawRPM = 0;
     value.RPM = 0;
+    value.duty = 0;
 
     _period = 0;
     _startPeriod = 0;
 
     _attachedFlag = false;
+
+    _overspeed.tripPeriod = 0;
+    _overspeed.releasePeriod = 0;
+    _overspeed.debounce = 1;
+    _overspeed.counter = 0;
+    _overspeed.state = false;
+
+    _underspeed.tripPeriod = UINT32_MAX;
+    _underspeed.releasePeriod = UINT32_MAX;
+    _underspeed.debounce = 1;
+    _underspeed.counter = 0;
+    _underspeed.state = false;
+
+    _thresholdCallback = nullptr;
+
+    _watchdog.htim = nullptr;
+    _watchdog.channel = TIM_CHANNEL_1;
+    _watchdog.interrupt = 0;
+    _watchdog.timeout = 0;
+    _watchdog.mask = 0;
+    _watchdog.lastEdgeTick = 0;
+
+    _stalled = false;
+    _stallCallback = nullptr;
+
+    _edgeCount = 0;
+    _edgeCountHigh = 0;
+    _totalOffset = 0;
+    _totalBackup = nullptr;
+    _totalSequence = 0;
+    _totalSaved = 0;
+    _totalInterval = 0;
+    _totalSaveTime = 0;
+    _userPulsesPerRevolution = 1;
+    _updateEdgeCount = 0;
+    _edgeState = {0, 0, 0};
+    _angle.marks = 0;
+    _angle.markStep = 0;
+    _angle.useIndex = false;
+    _angle.state = {0, 0, 0, 0};
+    _indexPending = false;
+    _edgeTime[0] = 0;
+    _edgeTime[1] = 0;
+    _edgeSeen = 0;
+    _width = 0;
+    _widthPeriod = 0;
+    _classifier = TachometerOptical_Core::makePulseClassifier(0, 0);
+    for(uint16_t i = 0; i < TACHOMETER_OPTICAL_EDGE_RING_SIZE; i++)
+    {
+      _edgeRing[i] = 0;
+    }
+    _rawEdgeCount = 0;
+    _resample.resampler = TachometerOptical_Core::makeResampler(0, TachometerOptical_Core::Interpolation::LINEAR);
+    _resample.block = {nullptr, 0, 0, 0, 0, nullptr};
+    _resample.edgeCount = 0;
+    _resample.classifier = TachometerOptical_Core::makePulseClassifier(0, 0);
+    _resample.start = 0;
+    _resample.period = 0;
+    _order.order = TachometerOptical_Core::makeOrder(0, 0);
+    _order.adcBuffer = nullptr;
+    _order.adcSize = 0;
+    _order.hdma = nullptr;
+    _order.adcPeriod = 0;
+    _order.block = {nullptr, 0, 0, 0, 0, nullptr};
+    _order.edgeCount = 0;
+    _order.period = 0;
+    _order.overruns = 0;
+    _jitterEnabled = false;
+    _jitterEdgeCount = 0;
+    for(uint8_t i = 0; i < TachometerOptical_Core::_JITTER_BINS; i++)
+    {
+      _jitter[i] = 0;
+    }
+    _toothDecoderEnabled = false;
+    _toothDecoder = {0, 0, 0, 0, 0, false, 0, 0};
+    _indexCallback = nullptr;
+    _pulsesPerRevolution = 1;
+    _capture = TachometerOptical_Core::makeCapture(nullptr, 0);
+    _captureFrozen = false;
+    _trigger = TachometerOptical_Core::makeTriggerCapture(nullptr, 0, 0, 0);
+    _triggerCondition = {0, 0, 0, false};
+    _triggerRawRPM = 0;
+    _triggerActive = 0;
+    _history = TachometerOptical_Core::makeHistory(nullptr, 0, 0, nullptr);
+    _histogram = {nullptr, nullptr, 0};
+    _warmup = TachometerOptical_Core::WarmupState::WAIT_FIRST_EDGE;
+    _adaptiveFilter = TachometerOptical_Core::makeAdaptiveFilter(0, 1);
+
+    #if defined(TACHOMETER_OPTICAL_FREERTOS)
+    _waitTask[WAIT_MEASUREMENT] = nullptr;
+    _waitTask[WAIT_REVOLUTION] = nullptr;
+    #elif defined(TACHOMETER_OPTICAL_CMSIS_RTOS2)
+    _waitFlags = nullptr;
+    #endif
 }
 
 TachometerOptical::~TachometerOptical() 
@@ -91,81 +207,333 @@ void TachometerOptical::update(void)
 	unsigned long t = TachometerOptical::_TIMER->micros();
   unsigned long dt = t - _T;
 
-  if(TachometerOptical::_UPDATE_FRQ > 0)
+  if(TachometerOptical_Core::updateDue(_config, dt) == false)
+  {
+    return ;
+  }
+
+  float alpha = TachometerOptical_Core::filterAlpha(_config, dt);
+
+  for(int i = 1; i <= 3; i++)
   {
-    if(dt < (1000000.0/TachometerOptical::_UPDATE_FRQ))
+    if( (_instances[i-1] != nullptr) && (_instances[i-1]->_attachedFlag == true) )
     {
-      return ;
+      _instances[i-1]->_updateChannel(t, dt, alpha);
     }
+  }	
+	
+		_T = t;
+	
+}	
+
+bool TachometerOptical::getMeasurement(MeasurementStructure &data)
+{
+  uint32_t sequence = _measurement.read(data);
+
+  if(sequence == 0)
+  {
+    return false;
   }
 
-  if(TachometerOptical::_FILTER_FRQ > 0)
+  data.sequence = sequence;
+
+  if(_stalled == true)
   {
-    TachometerOptical::_alpha = 1.0 / (1.0 + _2PI * TachometerOptical::_FILTER_FRQ * dt / 1000000.0);
+    data.RPM = 0;
+    data.rawRPM = 0;
+    data.duty = 0;
   }
-  else
+
+  return true;
+}
+
+bool TachometerOptical::getSnapshot(uint32_t timestamp, SnapshotStructure &snapshot)
+{
+  if(_TIMER == nullptr)
   {
-    TachometerOptical::_alpha = 0;
+    return false;
   }
 
-  for(int i = 1; i <= 3; i++)
+  snapshot.timestamp = timestamp;
+
+  for(int i = 0; i < 3; i++)
   {
-    if(_instances[i-1]->_attachedFlag == true)
+    TachometerOptical* object = _instances[i];
+    ChannelSnapshotStructure &channel = snapshot.channel[i];
+
+    channel.RPM = 0;
+    channel.age = 0;
+    channel.valid = false;
+
+    if( (object == nullptr) || (object->_attachedFlag == false) )
     {
-      float temp = (double)60.0/(double)(_instances[i-1]->_period)*1000000.0;
+      continue;
+    }
 
-      if( (t - TachometerOptical::_instances[i-1]->_startPeriod) >  1000000.0)
-      {
-        temp = 0;
-      }
+    TachometerOptical_Core::EdgeStateStructure state;
+    object->_edgeSnapshot.read(state);
 
-      if(temp > TachometerOptical::_MIN)
-      {
-        if( (float)(temp - _instances[i-1]->value.rawRPM) / (float)dt > 10000.0)
-        {
-          _instances[i-1]->value.rawRPM = temp;
-          continue;
-        }
-      }
+    channel.age = (int32_t)(timestamp - state.timestamp);
 
-      _instances[i-1]->value.rawRPM = temp;
+    if(object->_stalled == false)
+    {
+      channel.RPM = TachometerOptical_Core::estimateRPM(state, timestamp);
+      channel.valid = (state.period != 0) && (channel.age <= (int32_t)TachometerOptical_Core::_EDGE_TIMEOUT);
+    }
+  }
 
-      if(temp < TachometerOptical::_MIN)
-      {
-        temp = 0;
-      }
-      else if( (temp > TachometerOptical::_MAX) && (TachometerOptical::_MAX > 0) )
-      {
-        continue;
-      }
+  return true;
+}
+
+bool TachometerOptical::getSnapshot(SnapshotStructure &snapshot)
+{
+  if(_TIMER == nullptr)
+  {
+    return false;
+  }
+
+  return getSnapshot(_TIMER->micros(), snapshot);
+}
+
+void TachometerOptical::_updateChannel(uint32_t t, uint32_t dt, float alpha)
+{
+  TachometerOptical_Core::ChannelStructure channel = {value.rawRPM, value.RPM};
+
+  if(_jitterEnabled == true)
+  {
+    _drainJitter();
+  }
+
+  if(_resample.block.buffer != nullptr)
+  {
+    _drainResampler();
+  }
+
+  if(_order.adcBuffer != nullptr)
+  {
+    _drainOrder();
+  }
+
+  // The edge values and the warm-up state are shared with the edge and stall interrupts.
+  // The calculation is short, so it runs with interrupts disabled instead of a retry loop.
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint32_t period = _period;
+  uint32_t startPeriod = _startPeriod;
+  uint32_t width = _width;
+  uint32_t widthPeriod = _widthPeriod;
+  uint32_t newPulses = _edgeCount - _updateEdgeCount;
+  _updateEdgeCount += newPulses;
+  if((int32_t)newPulses < 0)
+  {
+    // Corrected pulses of the last update were undone.
+    newPulses = 0;
+  }
+  if(_adaptiveFilter.revolutions > 0)
+  {
+    alpha = TachometerOptical_Core::adaptiveAlpha(_adaptiveFilter, newPulses, t - startPeriod);
+  }
+  TachometerOptical_Core::WarmupState lastWarmup = _warmup;
+  TachometerOptical_Core::WarmupState warmup = lastWarmup;
+  bool updated = TachometerOptical_Core::updateChannelWarmup(_config, channel, warmup, alpha, period, t - startPeriod, _stalled, dt);
+  _warmup = warmup;
+  __set_PRIMASK(primask);
+
+  if(_trigger.buffer != nullptr)
+  {
+    _checkTrigger(t, dt, channel.rawRPM, lastWarmup, warmup);
+  }
+
+  if(updated == true)
+  {
+    ValuesStructure::sharedRPM = channel.RPM;
+  }
+
+  value.rawRPM = channel.rawRPM;
+  value.RPM = channel.RPM;
+
+  // The duty cycle is zero like the RPM value when there is no valid period.
+  if( (widthPeriod == 0) || (warmup < TachometerOptical_Core::WarmupState::SEED) || (_stalled == true) )
+  {
+    width = 0;
+    widthPeriod = 0;
+  }
+  value.duty = (widthPeriod > 0) ? 100.0f * (float)width / (float)widthPeriod : 0;
+
+  if( (_totalBackup != nullptr) && (t - _totalSaveTime >= _totalInterval) )
+  {
+    uint64_t total = getTotalPulses();
+    if(total != _totalSaved)
+    {
+      // The older record is written. The check word is written last, so a broken save leaves the newer record valid.
+      uint32_t sequence = _totalSequence + 1;
+      volatile uint32_t *record = _totalBackup + 4 * (sequence & 1);
+      record[0] = (uint32_t)total;
+      record[1] = (uint32_t)(total >> 32);
+      record[2] = sequence;
+      record[3] = (uint32_t)total ^ (uint32_t)(total >> 32) ^ sequence ^ TachometerOptical_Namespace::_TOTAL_CHECK;
+      _totalSequence = sequence;
+      _totalSaved = total;
+      _totalSaveTime = t;
+    }
+  }
+
+  if(_history.points != nullptr)
+  {
+    primask = __get_PRIMASK();
+    __disable_irq();
+    TachometerOptical_Core::historyAdd(_history, value.RPM);
+    __set_PRIMASK(primask);
+  }
+
+  _publish(period, startPeriod, width);
+}
+
+void TachometerOptical::_publish(uint32_t period, uint32_t timestamp, uint32_t width)
+{
+  MeasurementStructure data;
+
+  data.RPM = value.RPM;
+  data.rawRPM = value.rawRPM;
+  data.period = period;
+  data.timestamp = timestamp;
+  data.width = width;
+  data.duty = value.duty;
+  data.sequence = 0;
+
+  _measurement.write(data);
+
+  _notify(WAIT_MEASUREMENT);
+}
+
+bool TachometerOptical::waitForMeasurement(uint32_t timeout)
+{
+  return _wait(WAIT_MEASUREMENT, timeout);
+}
+
+bool TachometerOptical::waitForRevolution(uint32_t timeout)
+{
+  return _wait(WAIT_REVOLUTION, timeout);
+}
+
+uint32_t TachometerOptical::_eventCounter(WaitEvent event)
+{
+  return (event == WAIT_MEASUREMENT) ? _measurement.getSequence() : _edgeCount;
+}
+
+bool TachometerOptical::_wait(WaitEvent event, uint32_t timeout)
+{
+  uint32_t start = _eventCounter(event);
+
+  #if defined(TACHOMETER_OPTICAL_FREERTOS)
+
+    TimeOut_t timeOut;
+    TickType_t ticks = pdMS_TO_TICKS(timeout);
 
-      if(TachometerOptical::_FILTER_FRQ > 0)
+    vTaskSetTimeOutState(&timeOut);
+    _waitTask[event] = xTaskGetCurrentTaskHandle();
+
+    // Notifications may be left from an earlier wait, so the counter is checked after every wake.
+    while( (_eventCounter(event) == start) && (xTaskCheckForTimeOut(&timeOut, &ticks) == pdFALSE) )
+    {
+      ulTaskNotifyTake(pdTRUE, ticks);
+    }
+
+    _waitTask[event] = nullptr;
+
+  #elif defined(TACHOMETER_OPTICAL_CMSIS_RTOS2)
+
+    if(_waitFlags == nullptr)
+    {
+      _waitFlags = osEventFlagsNew(nullptr);
+      if(_waitFlags == nullptr)
       {
-        _instances[i-1]->value.RPM = _alpha * _instances[i-1]->value.RPM + (1.0 - _alpha) * temp;
+        return false;
       }
-      else
+    }
+
+    uint32_t flag = 1UL << event;
+    uint32_t ticks = (uint32_t)(((uint64_t)timeout * osKernelGetTickFreq() + 999) / 1000);
+    uint32_t tStart = osKernelGetTickCount();
+
+    osEventFlagsClear(_waitFlags, flag);
+
+    while(_eventCounter(event) == start)
+    {
+      uint32_t elapsed = osKernelGetTickCount() - tStart;
+      if(elapsed >= ticks)
       {
-        _instances[i-1]->value.RPM = temp;
+        break;
       }
+      osEventFlagsWait(_waitFlags, flag, osFlagsWaitAny, ticks - elapsed);
+    }
 
-      ValuesStructure::sharedRPM = _instances[i-1]->value.RPM;
+  #else
+
+    // Bare-metal: sleep until an event. _notify() sends SEV and any interrupt (eg: SysTick) also wakes the core.
+    if(_TIMER == nullptr)
+    {
+      return false;
     }
-  }	
-	
-		_T = t;
-	
-}	
+
+    uint32_t tStart = _TIMER->micros();
+    uint64_t timeoutUs = (uint64_t)timeout * 1000;
+
+    while( (_eventCounter(event) == start) && ((uint32_t)(_TIMER->micros() - tStart) < timeoutUs) )
+    {
+      __WFE();
+    }
+
+  #endif
+
+  return (_eventCounter(event) != start);
+}
+
+void TachometerOptical::_notify(WaitEvent event)
+{
+  #if defined(TACHOMETER_OPTICAL_FREERTOS)
+
+    TaskHandle_t task = _waitTask[event];
+    if(task == nullptr)
+    {
+      return;
+    }
+
+    if(xPortIsInsideInterrupt() == pdTRUE)
+    {
+      BaseType_t higherPriorityTaskWoken = pdFALSE;
+      vTaskNotifyGiveFromISR(task, &higherPriorityTaskWoken);
+      portYIELD_FROM_ISR(higherPriorityTaskWoken);
+    }
+    else
+    {
+      xTaskNotifyGive(task);
+    }
+
+  #elif defined(TACHOMETER_OPTICAL_CMSIS_RTOS2)
+
+    if(_waitFlags != nullptr)
+    {
+      osEventFlagsSet(_waitFlags, 1UL << event);
+    }
+
+  #else
+
+    (void)event;
+    __SEV();
+
+  #endif
+}
 
 bool TachometerOptical::setRange(uint16_t min, uint16_t max)
 {
   if(max < min)
   {
-    errorMessage = "Error TachometerOptical: The max RPM parameter value can not be less than The min RPM parameter value.";
+    sharedErrorCode = ErrorCode::RANGE_INVALID;
     return false;
   }
 
-  TachometerOptical::_MIN = min;
-  TachometerOptical::_MAX = max;
+  TachometerOptical::_config = TachometerOptical_Core::makeFilterConfig(min, max, _config.FILTER_FRQ, _config.UPDATE_FRQ);
 
   return true;
 }
@@ -174,11 +542,11 @@ bool TachometerOptical::setUpdateFrequency(float value)
 {
   if(value < 0)
   {
-    errorMessage = "Error TachometerOptical:: The update frequency parameter value can not be less than 0.";
+    sharedErrorCode = ErrorCode::UPDATE_FREQUENCY_INVALID;
     return false;
   }
 
-  TachometerOptical::_UPDATE_FRQ = value;
+  TachometerOptical::_config = TachometerOptical_Core::makeFilterConfig(_config.MIN, _config.MAX, _config.FILTER_FRQ, value);
   return true;
 }
 
@@ -186,11 +554,35 @@ bool TachometerOptical::setFilterFrequency(float value)
 {
   if(value < 0)
   {
-    errorMessage = "Error TachometerOptical: The filter frequency parameter value can not be less than 0.";
+    sharedErrorCode = ErrorCode::FILTER_FREQUENCY_INVALID;
+    return false;
+  }
+
+  TachometerOptical::_config = TachometerOptical_Core::makeFilterConfig(_config.MIN, _config.MAX, value, _config.UPDATE_FRQ);
+  return true;
+}
+
+bool TachometerOptical::setFilterConfig(const TachometerOptical_Core::FilterConfigStructure &config)
+{
+  if(config.MAX < config.MIN)
+  {
+    sharedErrorCode = ErrorCode::RANGE_INVALID;
+    return false;
+  }
+
+  if(config.UPDATE_FRQ < 0)
+  {
+    sharedErrorCode = ErrorCode::UPDATE_FREQUENCY_INVALID;
+    return false;
+  }
+
+  if(config.FILTER_FRQ < 0)
+  {
+    sharedErrorCode = ErrorCode::FILTER_FREQUENCY_INVALID;
     return false;
   }
 
-  TachometerOptical::_FILTER_FRQ = value;
+  TachometerOptical::_config = config;
   return true;
 }
 
@@ -198,13 +590,13 @@ bool TachometerOptical::setTimerControl(TimerControl* timer)
 {
   if(timer == nullptr)
   {
-    errorMessage = "Error TachometerOptical: The TimerControl object pointer can not be nullptr.";
+    sharedErrorCode = ErrorCode::TIMER_NULL;
     return false;
   }
 
   if(timer->getInitState() == false)
   {
-    errorMessage = "Error TachometerOptical: The TimerControl object must be initialized successfully before the TachometerOptical object.";
+    sharedErrorCode = ErrorCode::TIMER_NOT_INITIALIZED;
     return false;
   }
 
@@ -212,80 +604,1183 @@ bool TachometerOptical::setTimerControl(TimerControl* timer)
   return true;
 }
 
-bool TachometerOptical::init(void)
+void TachometerOptical::setEdgeSink(EdgeSinkPtr sink, void *context)
 {
-  if(!_checkParameters())
+  // The edge interrupt reads both values.
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  TachometerOptical::_edgeSink = sink;
+  TachometerOptical::_edgeSinkContext = context;
+  __set_PRIMASK(primask);
+}
+
+bool TachometerOptical::setOverspeedThreshold(float tripRPM, float releaseRPM, uint8_t debounce)
+{
+  if( (tripRPM < 0) || (releaseRPM < 0) || (releaseRPM > tripRPM) || (debounce == 0) )
   {
+    errorCode = ErrorCode::THRESHOLD_INVALID;
     return false;
   }
 
-  _period = 0;
-  _startPeriod = 0;
-
-  GPIO_InitTypeDef GPIO_InitStruct = {0};
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
 
-  if(parameters.GPIO_PORT != nullptr)
-  {   
-      RCC_GPIO_CLK_ENABLE(parameters.GPIO_PORT);
-      GPIO_InitStruct.Pin = parameters.GPIO_PIN;
-      GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
-      GPIO_InitStruct.Pull = GPIO_NOPULL;
-      HAL_GPIO_Init(parameters.GPIO_PORT, &GPIO_InitStruct);
-  }
-  
-  if(parameters.GPIO_PIN == GPIO_PIN_0)
-  {
-    HAL_NVIC_SetPriority(EXTI0_IRQn, 0, 0);
-    HAL_NVIC_EnableIRQ(EXTI0_IRQn);
-  }
-  else if(parameters.GPIO_PIN == GPIO_PIN_1)
-  {
-    HAL_NVIC_SetPriority(EXTI1_IRQn, 0, 0);
-    HAL_NVIC_EnableIRQ(EXTI1_IRQn);
-  }
-  else if(parameters.GPIO_PIN == GPIO_PIN_2)
+  if(tripRPM > 0)
   {
-    HAL_NVIC_SetPriority(EXTI2_IRQn, 0, 0);
-    HAL_NVIC_EnableIRQ(EXTI2_IRQn);
+    _overspeed.tripPeriod = (uint32_t)(60000000.0 / tripRPM);
+    _overspeed.releasePeriod = (releaseRPM > 0) ? (uint32_t)(60000000.0 / releaseRPM) : UINT32_MAX;
   }
-  else if(parameters.GPIO_PIN == GPIO_PIN_3)
+  else
   {
-    HAL_NVIC_SetPriority(EXTI3_IRQn, 0, 0);
-    HAL_NVIC_EnableIRQ(EXTI3_IRQn);
+    // period < 0 is never true, so the threshold is disabled.
+    _overspeed.tripPeriod = 0;
+    _overspeed.releasePeriod = 0;
   }
-  else if(parameters.GPIO_PIN == GPIO_PIN_4)
+  _overspeed.debounce = debounce;
+  _overspeed.counter = 0;
+  _overspeed.state = false;
+
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+bool TachometerOptical::setUnderspeedThreshold(float tripRPM, float releaseRPM, uint8_t debounce)
+{
+  if( (tripRPM < 0) || (releaseRPM < 0) || ( (tripRPM > 0) && (releaseRPM < tripRPM) ) || (debounce == 0) )
   {
-    HAL_NVIC_SetPriority(EXTI4_IRQn, 0, 0);
-    HAL_NVIC_EnableIRQ(EXTI4_IRQn);
+    errorCode = ErrorCode::THRESHOLD_INVALID;
+    return false;
   }
-  else if( (parameters.GPIO_PIN == GPIO_PIN_5) || (parameters.GPIO_PIN == GPIO_PIN_6) || (parameters.GPIO_PIN == GPIO_PIN_7) || (parameters.GPIO_PIN == GPIO_PIN_8) || (parameters.GPIO_PIN == GPIO_PIN_9) )
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  if(tripRPM > 0)
   {
-    HAL_NVIC_SetPriority(EXTI9_5_IRQn, 0, 0);
-    HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
+    _underspeed.tripPeriod = (uint32_t)(60000000.0 / tripRPM);
+    _underspeed.releasePeriod = (uint32_t)(60000000.0 / releaseRPM);
   }
-  else if( (parameters.GPIO_PIN == GPIO_PIN_10) || (parameters.GPIO_PIN == GPIO_PIN_11) || (parameters.GPIO_PIN == GPIO_PIN_12) || (parameters.GPIO_PIN == GPIO_PIN_13) || (parameters.GPIO_PIN == GPIO_PIN_14) || (parameters.GPIO_PIN == GPIO_PIN_15) )
+  else
   {
-    HAL_NVIC_SetPriority(EXTI15_10_IRQn, 0, 0);
-    HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
+    // period > UINT32_MAX is never true, so the threshold is disabled.
+    _underspeed.tripPeriod = UINT32_MAX;
+    _underspeed.releasePeriod = UINT32_MAX;
   }
-  else
+  _underspeed.debounce = debounce;
+  _underspeed.counter = 0;
+  _underspeed.state = false;
+
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+void TachometerOptical::setThresholdCallback(ThresholdCallbackPtr callback)
+{
+  _thresholdCallback = callback;
+}
+
+bool TachometerOptical::setAdaptiveFilter(float revolutions)
+{
+  if(revolutions < 0)
   {
-    errorMessage = "Error TachometerOptical: The GPIO_PIN parameter is not correct.";
+    errorCode = ErrorCode::PARAMETERS_INVALID;
     return false;
   }
 
-  EXTI_Callback = nullptr;
-  
-  switch(parameters.CHANNEL_NUM)
-  {
+  TachometerOptical_Core::AdaptiveFilterStructure filter = TachometerOptical_Core::makeAdaptiveFilter(revolutions, _pulsesPerRevolution);
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _adaptiveFilter = filter;
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+bool TachometerOptical::setPulseClassifier(float tolerance, uint8_t maxMissing)
+{
+  if( (tolerance < 0) || (tolerance >= 0.33f) || (maxMissing == 0) || (maxMissing > 4) )
+  {
+    errorCode = ErrorCode::PARAMETERS_INVALID;
+    return false;
+  }
+
+  TachometerOptical_Core::PulseClassifierStructure classifier = TachometerOptical_Core::makePulseClassifier(tolerance, maxMissing);
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  // The counters are kept.
+  classifier.missing = _classifier.missing;
+  classifier.extra = _classifier.extra;
+  _classifier = classifier;
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+bool TachometerOptical::setToothDecoder(bool enable)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  _toothDecoderEnabled = enable;
+  TachometerOptical_Core::resetToothDecoder(_toothDecoder);
+  _setPulsesPerRevolution(enable ? 1 : _userPulsesPerRevolution);
+  // The RPM values restart when the decoder locks.
+  _warmup = TachometerOptical_Core::WarmupState::WAIT_FIRST_EDGE;
+
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+void TachometerOptical::setIndexCallback(IndexCallbackPtr callback)
+{
+  _indexCallback = callback;
+}
+
+bool TachometerOptical::getToothState(ToothStructure &data)
+{
+  if(_toothDecoderEnabled == false)
+  {
+    return false;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  data.locked = _toothDecoder.locked;
+  data.pulsesPerRevolution = _toothDecoder.locked ? _toothDecoder.pulsesPerRevolution : 0;
+  data.missingTeeth = _toothDecoder.missing;
+  data.tooth = _toothDecoder.tooth;
+  data.revolutions = _toothDecoder.revolutions;
+  data.syncLoss = _toothDecoder.syncLoss;
+
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+bool TachometerOptical::setCapture(uint8_t *buffer, uint32_t size)
+{
+  TachometerOptical_Core::CaptureStructure capture = TachometerOptical_Core::makeCapture(buffer, size);
+
+  if( (buffer != nullptr) && (capture.buffer == nullptr) )
+  {
+    errorCode = ErrorCode::PARAMETERS_INVALID;
+    return false;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _capture = capture;
+  _captureFrozen = false;
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+bool TachometerOptical::captureBegin(TachometerOptical_Core::CaptureCursorStructure &cursor)
+{
+  if( (_capture.buffer == nullptr) || (_captureFrozen == false) )
+  {
+    return false;
+  }
+
+  // An edge interrupt that started before the freeze may still write.
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  TachometerOptical_Core::captureBegin(_capture, cursor);
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+bool TachometerOptical::captureNext(TachometerOptical_Core::CaptureCursorStructure &cursor)
+{
+  if( (_capture.buffer == nullptr) || (_captureFrozen == false) )
+  {
+    return false;
+  }
+
+  return TachometerOptical_Core::captureNext(_capture, cursor);
+}
+
+bool TachometerOptical::setTriggerCapture(uint32_t *buffer, uint16_t preEdges, uint16_t postEdges, uint8_t slots)
+{
+  TachometerOptical_Core::TriggerCaptureStructure capture = TachometerOptical_Core::makeTriggerCapture(buffer, preEdges, postEdges, slots);
+
+  if( (buffer != nullptr) && (capture.buffer == nullptr) )
+  {
+    errorCode = ErrorCode::PARAMETERS_INVALID;
+    return false;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _trigger = capture;
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+bool TachometerOptical::setTriggerConditions(float aboveRPM, float belowRPM, float slew, bool stall)
+{
+  if( (aboveRPM < 0) || (belowRPM < 0) || (slew < 0) || ( (aboveRPM > 0) && (belowRPM >= aboveRPM) ) )
+  {
+    errorCode = ErrorCode::PARAMETERS_INVALID;
+    return false;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _triggerCondition.aboveRPM = aboveRPM;
+  _triggerCondition.belowRPM = belowRPM;
+  // RPM/s to RPM/us like the update() time base.
+  _triggerCondition.slew = slew / 1000000.0f;
+  _triggerCondition.stall = stall;
+  // Conditions that are already true fire at the next update().
+  _triggerActive = 0;
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+bool TachometerOptical::trigger(void)
+{
+  if( (_trigger.buffer == nullptr) || (_TIMER == nullptr) )
+  {
+    return false;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  bool state = TachometerOptical_Core::triggerFire(_trigger, TachometerOptical_Core::TriggerEvent::EXTERNAL, _TIMER->micros());
+  __set_PRIMASK(primask);
+
+  return state;
+}
+
+bool TachometerOptical::getTriggerSlot(uint8_t slot, TachometerOptical_Core::TriggerSlotStructure &data)
+{
+  // Captured slots are not written by the edge interrupt.
+  if(slot >= _trigger.active)
+  {
+    return false;
+  }
+
+  data = _trigger.slot[slot];
+
+  return true;
+}
+
+uint16_t TachometerOptical::readTriggerSlot(uint8_t slot, uint32_t *edges, uint16_t size, uint16_t &preEdges)
+{
+  preEdges = 0;
+
+  if(edges == nullptr)
+  {
+    return 0;
+  }
+
+  return TachometerOptical_Core::triggerRead(_trigger, slot, edges, size, preEdges);
+}
+
+bool TachometerOptical::setHistory(TachometerOptical_Core::HistoryPointStructure *buffer, uint16_t points, uint8_t tiers, const uint16_t *factors)
+{
+  TachometerOptical_Core::HistoryStructure history = TachometerOptical_Core::makeHistory(buffer, points, tiers, factors);
+
+  if( (buffer != nullptr) && (history.points == nullptr) )
+  {
+    errorCode = ErrorCode::PARAMETERS_INVALID;
+    return false;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _history = history;
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+uint16_t TachometerOptical::getHistory(uint8_t tier, TachometerOptical_Core::HistoryPointStructure *points, uint16_t count)
+{
+  if( (_history.points == nullptr) || (points == nullptr) )
+  {
+    return 0;
+  }
+
+  uint16_t available = TachometerOptical_Core::historyAvailable(_history, tier);
+  if(count > available)
+  {
+    count = available;
+  }
+
+  // Points are copied one by one, so update() in another task or interrupt is never blocked for long.
+  for(uint16_t i = 0; i < count; i++)
+  {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    points[i] = TachometerOptical_Core::historyPoint(_history, tier, count - 1 - i);
+    __set_PRIMASK(primask);
+  }
+
+  return count;
+}
+
+uint16_t TachometerOptical::getTrend(float span, TachometerOptical_Core::HistoryPointStructure *points, uint16_t count, float &interval)
+{
+  interval = 0;
+
+  if( (_history.points == nullptr) || (_config.UPDATE_FRQ <= 0) || (span <= 0) || (count == 0) )
+  {
+    return 0;
+  }
+
+  uint32_t samples = (uint32_t)(span * _config.UPDATE_FRQ);
+  uint8_t tier = TachometerOptical_Core::historyTier(_history, samples, count);
+
+  float samplesPerPoint = 1;
+  for(uint8_t i = 0; i <= tier; i++)
+  {
+    samplesPerPoint *= (float)_history.factor[i];
+  }
+  interval = samplesPerPoint / _config.UPDATE_FRQ;
+
+  // Points of the span. The last tier may not cover it.
+  uint32_t needed = (uint32_t)(samples / samplesPerPoint + 0.5f);
+  if(needed < 1)
+  {
+    needed = 1;
+  }
+  if(needed < count)
+  {
+    count = (uint16_t)needed;
+  }
+
+  return getHistory(tier, points, count);
+}
+
+uint64_t TachometerOptical::getTotalPulses(void)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint64_t total = _totalOffset + (((uint64_t)_edgeCountHigh << 32) | _edgeCount);
+  __set_PRIMASK(primask);
+
+  return total;
+}
+
+uint64_t TachometerOptical::getTotalRevolutions(void)
+{
+  return getTotalPulses() / _pulsesPerRevolution;
+}
+
+bool TachometerOptical::setPulsesPerRevolution(uint16_t pulses)
+{
+  if(pulses == 0)
+  {
+    errorCode = ErrorCode::PARAMETERS_INVALID;
+    return false;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _userPulsesPerRevolution = pulses;
+  if(_toothDecoderEnabled == false)
+  {
+    _setPulsesPerRevolution(pulses);
+  }
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+void TachometerOptical::setTotalPulses(uint64_t pulses)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _totalOffset = pulses - (((uint64_t)_edgeCountHigh << 32) | _edgeCount);
+  __set_PRIMASK(primask);
+}
+
+bool TachometerOptical::setTotalizerBackup(volatile uint32_t *backup, uint32_t interval)
+{
+  _totalBackup = nullptr;
+
+  if(backup == nullptr)
+  {
+    return false;
+  }
+
+  bool valid = false;
+  uint64_t total = 0;
+  uint32_t sequence = 0;
+
+  for(uint8_t i = 0; i < 2; i++)
+  {
+    volatile uint32_t *record = backup + 4 * i;
+    uint32_t low = record[0];
+    uint32_t high = record[1];
+    uint32_t recordSequence = record[2];
+
+    // Record i has the sequence numbers with bit 0 equal to i.
+    if( ((low ^ high ^ recordSequence ^ TachometerOptical_Namespace::_TOTAL_CHECK) != record[3]) || ((recordSequence & 1) != i) )
+    {
+      continue;
+    }
+
+    // The newest valid record. Sequence numbers are compared with wrap-around.
+    if( (valid == false) || ((int32_t)(recordSequence - sequence) > 0) )
+    {
+      total = ((uint64_t)high << 32) | low;
+      sequence = recordSequence;
+      valid = true;
+    }
+  }
+
+  if(valid == true)
+  {
+    setTotalPulses(total);
+  }
+
+  _totalSequence = sequence;
+  _totalSaved = getTotalPulses();
+  // The interval is limited to 1 hour, so it fits in the 32-bit micros() range.
+  _totalInterval = ((interval < 3600000) ? interval : 3600000) * 1000;
+  _totalSaveTime = (_TIMER != nullptr) ? (uint32_t)_TIMER->micros() - _totalInterval : 0;
+  _totalBackup = backup;
+
+  return valid;
+}
+
+bool TachometerOptical::setHistogram(const float *RPMEdges, uint16_t edges, uint32_t *periodEdges, uint64_t *bins)
+{
+  if(bins == nullptr)
+  {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    _histogram = {nullptr, nullptr, 0};
+    __set_PRIMASK(primask);
+    return true;
+  }
+
+  // The edge interrupt must not use the arrays while they are filled.
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _histogram.bins = nullptr;
+  __set_PRIMASK(primask);
+
+  TachometerOptical_Core::HistogramStructure histogram = TachometerOptical_Core::makeHistogram(RPMEdges, edges, periodEdges, bins);
+
+  if(histogram.bins == nullptr)
+  {
+    errorCode = ErrorCode::PARAMETERS_INVALID;
+    return false;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  _histogram = histogram;
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+uint64_t TachometerOptical::getHistogramBin(uint16_t bin)
+{
+  if( (_histogram.bins == nullptr) || (bin > _histogram.edges) )
+  {
+    return 0;
+  }
+
+  // 64-bit values are not written atomically by the edge interrupt.
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint64_t time = _histogram.bins[bin];
+  __set_PRIMASK(primask);
+
+  return time;
+}
+
+void TachometerOptical::_checkTrigger(uint32_t t, uint32_t dt, float rawRPM, TachometerOptical_Core::WarmupState lastWarmup, TachometerOptical_Core::WarmupState warmup)
+{
+  bool running = (warmup == TachometerOptical_Core::WarmupState::RUNNING);
+  float change = (rawRPM > _triggerRawRPM) ? (rawRPM - _triggerRawRPM) : (_triggerRawRPM - rawRPM);
+  uint8_t active = 0;
+
+  if( (_triggerCondition.aboveRPM > 0) && (rawRPM > _triggerCondition.aboveRPM) )
+  {
+    active |= (1 << (uint8_t)TachometerOptical_Core::TriggerEvent::RPM_ABOVE);
+  }
+  if( (_triggerCondition.belowRPM > 0) && (running == true) && (rawRPM < _triggerCondition.belowRPM) )
+  {
+    active |= (1 << (uint8_t)TachometerOptical_Core::TriggerEvent::RPM_BELOW);
+  }
+  if( (_triggerCondition.slew > 0) && (running == true) && (lastWarmup == TachometerOptical_Core::WarmupState::RUNNING) && 
+      (change > _triggerCondition.slew * (float)dt) )
+  {
+    active |= (1 << (uint8_t)TachometerOptical_Core::TriggerEvent::SLEW);
+  }
+  if( (_triggerCondition.stall == true) && (lastWarmup >= TachometerOptical_Core::WarmupState::SEED) && 
+      (warmup == TachometerOptical_Core::WarmupState::WAIT_FIRST_EDGE) )
+  {
+    // Edge timeout without the stall watchdog.
+    active |= (1 << (uint8_t)TachometerOptical_Core::TriggerEvent::STALL);
+  }
+
+  _triggerRawRPM = rawRPM;
+
+  // A condition fires only when it becomes true. It is armed again when it is false.
+  uint8_t rising = active & (uint8_t)~_triggerActive;
+  _triggerActive = active;
+
+  TachometerOptical_Core::TriggerEvent event = TachometerOptical_Core::TriggerEvent::NONE;
+
+  for(uint8_t i = (uint8_t)TachometerOptical_Core::TriggerEvent::RPM_ABOVE; i <= (uint8_t)TachometerOptical_Core::TriggerEvent::STALL; i++)
+  {
+    if(rising & (1 << i))
+    {
+      event = (TachometerOptical_Core::TriggerEvent)i;
+      break;
+    }
+  }
+
+  if(event == TachometerOptical_Core::TriggerEvent::NONE)
+  {
+    return;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  TachometerOptical_Core::triggerFire(_trigger, event, t);
+  __set_PRIMASK(primask);
+}
+
+void TachometerOptical::setJitterHistogram(bool enable)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  for(uint8_t i = 0; i < TachometerOptical_Core::_JITTER_BINS; i++)
+  {
+    _jitter[i] = 0;
+  }
+  _jitterEdgeCount = _rawEdgeCount;
+  _jitterEnabled = enable;
+
+  __set_PRIMASK(primask);
+}
+
+bool TachometerOptical::getJitterHistogram(uint32_t *bins)
+{
+  if( (_jitterEnabled == false) || (bins == nullptr) )
+  {
+    return false;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  for(uint8_t i = 0; i < TachometerOptical_Core::_JITTER_BINS; i++)
+  {
+    bins[i] = _jitter[i];
+  }
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+void TachometerOptical::_drainJitter(void)
+{
+  const uint32_t mask = TACHOMETER_OPTICAL_EDGE_RING_SIZE - 1;
+
+  // At most TACHOMETER_OPTICAL_EDGE_RING_SIZE edges are read, so the ring is drained with interrupts disabled.
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  uint32_t count = _rawEdgeCount;
+  uint32_t first = _jitterEdgeCount;
+  _jitterEdgeCount = count;
+
+  // Edge k needs the edges k - 1 and k - 2. Older edges are overwritten.
+  if(count - first > TACHOMETER_OPTICAL_EDGE_RING_SIZE - 2)
+  {
+    first = count - (TACHOMETER_OPTICAL_EDGE_RING_SIZE - 2);
+  }
+  if(first < 2)
+  {
+    first = 2;
+  }
+
+  for(uint32_t k = first; k < count; k++)
+  {
+    uint32_t last = _edgeRing[(k - 1) & mask];
+    uint32_t period = _edgeRing[k & mask] - last;
+    uint32_t predicted = last - _edgeRing[(k - 2) & mask];
+
+    // Periods over a stall are not sensor jitter.
+    if( (period > TachometerOptical_Core::_EDGE_TIMEOUT) || (predicted > TachometerOptical_Core::_EDGE_TIMEOUT) )
+    {
+      continue;
+    }
+
+    // The gap of a missing-tooth wheel and the period after it are not sensor jitter. The same gap test as the tooth decoder.
+    if( (_toothDecoderEnabled == true) && ( (period / 2 > predicted - predicted / 4) || (predicted / 2 > period - period / 4) ) )
+    {
+      continue;
+    }
+
+    _jitter[TachometerOptical_Core::jitterBin((period > predicted) ? period - predicted : predicted - period)]++;
+  }
+
+  __set_PRIMASK(primask);
+}
+
+bool TachometerOptical::setResampler(float rate, TachometerOptical_Core::Interpolation mode, float *buffer, uint16_t blockSize, BlockCallbackPtr callback)
+{
+  if( (buffer != nullptr) && ( (rate <= 0) || (blockSize == 0) || (callback == nullptr) ) )
+  {
+    errorCode = ErrorCode::PARAMETERS_INVALID;
+    return false;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _resample.resampler = TachometerOptical_Core::makeResampler(rate, mode);
+  _resample.block = {buffer, blockSize, 0, 0, 0, callback};
+  _resample.edgeCount = _rawEdgeCount;
+  _resample.classifier = TachometerOptical_Core::makePulseClassifier(0, 0);
+  _resample.period = 0;
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+void TachometerOptical::_drainResampler(void)
+{
+  uint32_t edges[TACHOMETER_OPTICAL_EDGE_RING_SIZE];
+  uint32_t first = _resample.edgeCount;
+  uint32_t number = _copyEdges(first, edges);
+
+  // Edges are lost if the first copied edge is not the next edge.
+  bool lost = (first != _resample.edgeCount);
+  _resample.edgeCount = first + ((number > 0) ? number - 1 : 0);
+
+  if( (_resample.classifier.tolerance != _classifier.tolerance) || (_resample.classifier.maxMissing != _classifier.maxMissing) )
+  {
+    // The classifier configuration is changed.
+    _resample.classifier = TachometerOptical_Core::makePulseClassifier((float)_classifier.tolerance / 256.0f, _classifier.maxMissing);
+    _resample.period = 0;
+  }
+
+  for(uint32_t i = 1; i < number; i++)
+  {
+    uint32_t start = (_resample.classifier.fragment != 0) ? _resample.start : edges[i - 1];
+    uint32_t period = edges[i] - edges[i - 1];
+    uint32_t pulsePeriod = period;
+    uint8_t pulses = 1;
+    bool restart = (period > TachometerOptical_Core::_EDGE_TIMEOUT) || ( (i == 1) && (lost == true) );
+
+    if(restart == false)
+    {
+      if(_toothDecoderEnabled == true)
+      {
+        restart = (_toothDecoder.locked == false);
+
+        if( (restart == false) && (_resample.period == 0) )
+        {
+          // The first period after a restart is only the tooth period reference. It may be the gap.
+          _resample.period = period;
+          continue;
+        }
+
+        if(restart == false)
+        {
+          // The gap has missing + 1 tooth periods.
+          uint32_t ratio = (period + _resample.period / 2) / _resample.period;
+          uint32_t maxPulses = (uint32_t)_toothDecoder.missing + 1;
+          pulses = (uint8_t)( (ratio < 1) ? 1 : ( (ratio > maxPulses) ? maxPulses : ratio ) );
+          pulsePeriod = period / pulses;
+        }
+      }
+      else if(_resample.classifier.tolerance != 0)
+      {
+        TachometerOptical_Core::classifyPulse(_resample.classifier, period, pulsePeriod, pulses);
+        if(pulses == 0)
+        {
+          // A short fragment. It is used with the next edge.
+          _resample.start = start;
+          continue;
+        }
+      }
+    }
+
+    _resample.period = (restart == true) ? 0 : pulsePeriod;
+
+    if(restart == true)
+    {
+      // The shaft was stopped or the pulses are not known. The stream restarts from this edge.
+      if(_resample.block.fill > 0)
+      {
+        _sendBlock(_resample.block);
+      }
+      TachometerOptical_Core::resampleReset(_resample.resampler);
+      _resample.classifier = TachometerOptical_Core::makePulseClassifier((float)_classifier.tolerance / 256.0f, _classifier.maxMissing);
+      continue;
+    }
+
+    // Float product, so it does not wrap for long periods with many pulses per revolution.
+    float speed = TachometerOptical_Core::_RPM_US / ((float)pulsePeriod * (float)_pulsesPerRevolution);
+    uint32_t length = edges[i] - start;
+
+    for(uint8_t n = 0; n < pulses; n++)
+    {
+      // The speed of a pulse period is at its middle time.
+      TachometerOptical_Core::resamplePoint(_resample.resampler, start + (uint32_t)(((uint64_t)length * (2 * n + 1)) / (2 * pulses)), speed);
+
+      uint32_t timestamp;
+      float sample;
+      while(TachometerOptical_Core::resampleNext(_resample.resampler, timestamp, sample) == true)
+      {
+        _writeBlock(_resample.block, timestamp, sample);
+      }
+    }
+  }
+}
+
+bool TachometerOptical::setOrderTracking(const OrderConfigStructure &config)
+{
+  bool valid = (config.samplesPerRevolution > 0) && (config.marks > 0) && (config.adcSize >= 4) && (config.hdma != nullptr) && 
+               (config.adcRate > 0) && (config.buffer != nullptr) && (config.blockSize > 0) && (config.callback != nullptr);
+
+  if( (config.adcBuffer != nullptr) && (valid == false) )
+  {
+    errorCode = ErrorCode::PARAMETERS_INVALID;
+    return false;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  _order.order = TachometerOptical_Core::makeOrder(config.samplesPerRevolution, config.marks);
+  _order.adcBuffer = config.adcBuffer;
+  _order.adcSize = config.adcSize;
+  _order.hdma = config.hdma;
+  _order.adcPeriod = 1000000.0f / config.adcRate;
+  _order.block = {config.buffer, config.blockSize, 0, 0, 0, config.callback};
+  _order.edgeCount = _rawEdgeCount;
+  _order.period = 0;
+  _order.overruns = 0;
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+void TachometerOptical::_drainOrder(void)
+{
+  // The DMA write position and the time are read together. The DMA write position is the newest ADC sample at time t.
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint32_t t = _TIMER->micros();
+  uint32_t adcIndex = _order.adcSize - __HAL_DMA_GET_COUNTER(_order.hdma);
+  __set_PRIMASK(primask);
+
+  if(adcIndex >= _order.adcSize)
+  {
+    adcIndex = 0;
+  }
+
+  uint32_t edges[TACHOMETER_OPTICAL_EDGE_RING_SIZE];
+  uint32_t first = _order.edgeCount;
+  uint32_t number = _copyEdges(first, edges);
+
+  if(first != _order.edgeCount)
+  {
+    // Edges are lost. The angle of the next edge is not known.
+    _order.period = 0;
+  }
+
+  // Interpolation needs the ADC sample after the sample time.
+  int32_t margin = (int32_t)(2.0f * _order.adcPeriod) + 1;
+  uint32_t processed = 1;
+
+  for(; processed < number; processed++)
+  {
+    uint32_t start = edges[processed - 1];
+    uint32_t period = edges[processed] - start;
+
+    if((int32_t)(t - edges[processed]) < margin)
+    {
+      // The ADC samples of this segment are not converted yet. It is processed in the next update().
+      break;
+    }
+
+    uint16_t marks = _order.order.marks;
+    uint8_t steps = 1;
+    bool restart = (_order.period == 0) || (period > TachometerOptical_Core::_EDGE_TIMEOUT);
+
+    if(_toothDecoderEnabled == true)
+    {
+      marks = _toothDecoder.pulsesPerRevolution;
+      restart = restart || (_toothDecoder.locked == false) || (marks != _order.order.marks);
+
+      if(_order.period != 0)
+      {
+        // The gap has missing + 1 tooth periods.
+        uint32_t ratio = (period + _order.period / 2) / _order.period;
+        uint32_t maxSteps = (uint32_t)_toothDecoder.missing + 1;
+        steps = (uint8_t)( (ratio < 1) ? 1 : ( (ratio > maxSteps) ? maxSteps : ratio ) );
+      }
+    }
+
+    _order.period = (period > TachometerOptical_Core::_EDGE_TIMEOUT) ? 0 : period / steps;
+
+    if(restart == true)
+    {
+      // The angle grid restarts at the end of this segment. The partial block is given to the callback.
+      if(_order.block.fill > 0)
+      {
+        _sendBlock(_order.block);
+      }
+      _order.order.marks = marks;
+      _order.order.position = 0;
+      continue;
+    }
+
+    uint32_t time;
+    while(TachometerOptical_Core::orderNext(_order.order, start, period, steps, time) == true)
+    {
+      // ADC samples back from the newest sample. The newest sample is at the middle of its sample period before t.
+      float back = (float)(int32_t)(t - time) / _order.adcPeriod - 0.5f;
+      if(back < 0)
+      {
+        back = 0;
+      }
+      uint32_t whole = (uint32_t)back;
+      float fraction = back - (float)whole;
+      float sample = 0;
+
+      if(whole + 2 < _order.adcSize)
+      {
+        uint32_t newer = (adcIndex + 2 * _order.adcSize - 1 - whole) % _order.adcSize;
+        uint32_t older = (newer == 0) ? _order.adcSize - 1 : newer - 1;
+        sample = (1.0f - fraction) * (float)_order.adcBuffer[newer] + fraction * (float)_order.adcBuffer[older];
+      }
+      else
+      {
+        _order.overruns++;
+      }
+
+      _writeBlock(_order.block, time, sample);
+    }
+  }
+
+  // edges[processed - 1] is the last processed edge.
+  _order.edgeCount = first + processed - 1;
+}
+
+uint32_t TachometerOptical::_copyEdges(uint32_t &first, uint32_t *edges)
+{
+  const uint32_t mask = TACHOMETER_OPTICAL_EDGE_RING_SIZE - 1;
+
+  // The new edges and the edge before them are copied, so the processing runs with interrupts enabled.
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  uint32_t count = _rawEdgeCount;
+  if(count - first > TACHOMETER_OPTICAL_EDGE_RING_SIZE - 1)
+  {
+    first = count - (TACHOMETER_OPTICAL_EDGE_RING_SIZE - 1);
+  }
+  if(first < 1)
+  {
+    first = 1;
+  }
+
+  uint32_t number = (count > first) ? count - first + 1 : 0;
+  for(uint32_t i = 0; i < number; i++)
+  {
+    edges[i] = _edgeRing[(first - 1 + i) & mask];
+  }
+
+  __set_PRIMASK(primask);
+
+  return number;
+}
+
+void TachometerOptical::_writeBlock(BlockStructure &block, uint32_t timestamp, float sample)
+{
+  if(block.fill == 0)
+  {
+    block.timestamp = timestamp;
+  }
+
+  block.buffer[block.half * block.size + block.fill] = sample;
+
+  if(++block.fill == block.size)
+  {
+    _sendBlock(block);
+  }
+}
+
+void TachometerOptical::_sendBlock(BlockStructure &block)
+{
+  const float *data = block.buffer + block.half * block.size;
+  uint16_t size = block.fill;
+
+  block.half ^= 1;
+  block.fill = 0;
+
+  block.callback(parameters.CHANNEL_NUM, data, size, block.timestamp);
+}
+
+void TachometerOptical::_setPulsesPerRevolution(uint16_t pulsesPerRevolution)
+{
+  if(pulsesPerRevolution == _pulsesPerRevolution)
+  {
+    return;
+  }
+
+  _pulsesPerRevolution = pulsesPerRevolution;
+  _adaptiveFilter = TachometerOptical_Core::makeAdaptiveFilter(_adaptiveFilter.revolutions, pulsesPerRevolution);
+
+  if(_angle.marks > 0)
+  {
+    // The mark count of the old marks is not valid. eg: teeth counted before the decoder locked.
+    _angle.marks = pulsesPerRevolution;
+    _angle.markStep = 1.0f / (float)pulsesPerRevolution;
+    _angle.useIndex = (pulsesPerRevolution > 1);
+    _angle.state = {0, 0, 0, 0};
+    _angleSnapshot.write(_angle.state);
+    _indexPending = false;
+  }
+}
+
+bool TachometerOptical::setAngleEstimator(uint16_t marks, bool useIndex)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  _angle.marks = marks;
+  _angle.markStep = (marks > 0) ? 1.0f / (float)marks : 0;
+  _angle.useIndex = useIndex;
+  _angle.state = {0, 0, 0, 0};
+  _angleSnapshot.write(_angle.state);
+  _indexPending = false;
+
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+bool TachometerOptical::getAngle(uint32_t timestamp, AngleStructure &data)
+{
+  if(_angle.marks == 0)
+  {
+    return false;
+  }
+
+  TachometerOptical_Core::AngleStateStructure state;
+  _angleSnapshot.read(state);
+
+  if(_stalled == true)
+  {
+    // The shaft is stopped at the last mark.
+    state.period = 0;
+  }
+
+  data.revolutions = state.revolutions;
+  data.angle = TachometerOptical_Core::estimateAngle(state, _angle.markStep, timestamp);
+  data.valid = (state.period != 0);
+
+  return true;
+}
+
+bool TachometerOptical::getAngle(AngleStructure &data)
+{
+  if(_TIMER == nullptr)
+  {
+    return false;
+  }
+
+  return getAngle(_TIMER->micros(), data);
+}
+
+bool TachometerOptical::setStallWatchdog(TIM_HandleTypeDef* htim, uint32_t channel, uint32_t timeout)
+{
+  if(htim != nullptr)
+  {
+    uint32_t mask = __HAL_TIM_GET_AUTORELOAD(htim);
+
+    bool state = ( (channel == TIM_CHANNEL_1) || (channel == TIM_CHANNEL_2) || (channel == TIM_CHANNEL_3) || (channel == TIM_CHANNEL_4) ) &&
+                 (timeout > 0) && (timeout < mask) && ( (mask == 0xFFFF) || (mask == 0xFFFFFFFF) );
+
+    if(state == false)
+    {
+      errorCode = ErrorCode::WATCHDOG_INVALID;
+      return false;
+    }
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  if(_watchdog.htim != nullptr)
+  {
+    __HAL_TIM_DISABLE_IT(_watchdog.htim, _watchdog.interrupt);
+  }
+
+  _watchdog.htim = htim;
+  _stalled = false;
+
+  if(htim != nullptr)
+  {
+    _watchdog.channel = channel;
+    // TIM_IT_CC1..TIM_IT_CC4 (and TIM_FLAG_CC1..TIM_FLAG_CC4) are consecutive bits and TIM_CHANNEL_x steps by 4.
+    _watchdog.interrupt = TIM_IT_CC1 << (channel >> 2);
+    _watchdog.timeout = timeout;
+    _watchdog.mask = __HAL_TIM_GET_AUTORELOAD(htim);
+    _watchdog.lastEdgeTick = __HAL_TIM_GET_COUNTER(htim);
+
+    __HAL_TIM_SET_COMPARE(htim, channel, (_watchdog.lastEdgeTick + timeout) & _watchdog.mask);
+    __HAL_TIM_CLEAR_FLAG(htim, _watchdog.interrupt);
+    __HAL_TIM_ENABLE_IT(htim, _watchdog.interrupt);
+  }
+
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+void TachometerOptical::setStallCallback(StallCallbackPtr callback)
+{
+  _stallCallback = callback;
+}
+
+bool TachometerOptical::init(void)
+{
+  if(!_checkParameters())
+  {
+    return false;
+  }
+
+  _period = 0;
+  _startPeriod = 0;
+  _edgeCount = 0;
+  _edgeCountHigh = 0;
+  _updateEdgeCount = 0;
+  _warmup = TachometerOptical_Core::WarmupState::WAIT_FIRST_EDGE;
+  _edgeState = {0, 0, 0};
+  _edgeSnapshot.write(_edgeState);
+  _angle.state = {0, 0, 0, 0};
+  _angleSnapshot.write(_angle.state);
+  _indexPending = false;
+  _edgeTime[0] = 0;
+  _edgeTime[1] = 0;
+  _edgeSeen = 0;
+  _width = 0;
+  _widthPeriod = 0;
+  value.duty = 0;
+  _classifier.expected = 0;
+  _classifier.fragment = 0;
+  _classifier.last = TachometerOptical_Core::PulseClass::NORMAL;
+  _classifier.missing = 0;
+  _classifier.extra = 0;
+  for(uint16_t i = 0; i < TACHOMETER_OPTICAL_EDGE_RING_SIZE; i++)
+  {
+    _edgeRing[i] = 0;
+  }
+  _rawEdgeCount = 0;
+  _jitterEdgeCount = 0;
+  _resample.edgeCount = 0;
+  _resample.period = 0;
+  _order.edgeCount = 0;
+  _order.period = 0;
+  _toothDecoder = {0, 0, 0, 0, 0, false, 0, 0};
+
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  if(parameters.PWM_TIMER != nullptr)
+  {
+    // The timer and its input pin are configured outside of the object.
+  }
+  else if(parameters.GPIO_PORT != nullptr)
+  {   
+      RCC_GPIO_CLK_ENABLE(parameters.GPIO_PORT);
+      GPIO_InitStruct.Pin = parameters.GPIO_PIN;
+      GPIO_InitStruct.Mode = (parameters.EDGE_MODE == EdgeMode::FALLING) ? GPIO_MODE_IT_FALLING : 
+                             (parameters.EDGE_MODE == EdgeMode::BOTH) ? GPIO_MODE_IT_RISING_FALLING : GPIO_MODE_IT_RISING;
+      GPIO_InitStruct.Pull = GPIO_NOPULL;
+      HAL_GPIO_Init(parameters.GPIO_PORT, &GPIO_InitStruct);
+  }
+  
+  if(parameters.PWM_TIMER != nullptr)
+  {
+    // The timer interrupt is enabled outside of the object.
+  }
+  else if(parameters.GPIO_PIN == GPIO_PIN_0)
+  {
+    HAL_NVIC_SetPriority(EXTI0_IRQn, parameters.INTERRUPT_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(EXTI0_IRQn);
+  }
+  else if(parameters.GPIO_PIN == GPIO_PIN_1)
+  {
+    HAL_NVIC_SetPriority(EXTI1_IRQn, parameters.INTERRUPT_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(EXTI1_IRQn);
+  }
+  else if(parameters.GPIO_PIN == GPIO_PIN_2)
+  {
+    HAL_NVIC_SetPriority(EXTI2_IRQn, parameters.INTERRUPT_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(EXTI2_IRQn);
+  }
+  else if(parameters.GPIO_PIN == GPIO_PIN_3)
+  {
+    HAL_NVIC_SetPriority(EXTI3_IRQn, parameters.INTERRUPT_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(EXTI3_IRQn);
+  }
+  else if(parameters.GPIO_PIN == GPIO_PIN_4)
+  {
+    HAL_NVIC_SetPriority(EXTI4_IRQn, parameters.INTERRUPT_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(EXTI4_IRQn);
+  }
+  else if( (parameters.GPIO_PIN == GPIO_PIN_5) || (parameters.GPIO_PIN == GPIO_PIN_6) || (parameters.GPIO_PIN == GPIO_PIN_7) || (parameters.GPIO_PIN == GPIO_PIN_8) || (parameters.GPIO_PIN == GPIO_PIN_9) )
+  {
+    HAL_NVIC_SetPriority(EXTI9_5_IRQn, parameters.INTERRUPT_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
+  }
+  else if( (parameters.GPIO_PIN == GPIO_PIN_10) || (parameters.GPIO_PIN == GPIO_PIN_11) || (parameters.GPIO_PIN == GPIO_PIN_12) || (parameters.GPIO_PIN == GPIO_PIN_13) || (parameters.GPIO_PIN == GPIO_PIN_14) || (parameters.GPIO_PIN == GPIO_PIN_15) )
+  {
+    HAL_NVIC_SetPriority(EXTI15_10_IRQn, parameters.INTERRUPT_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
+  }
+  else
+  {
+    errorCode = ErrorCode::GPIO_PIN_INVALID;
+    return false;
+  }
+
+  EXTI_Callback = nullptr;
+  STALL_Callback = nullptr;
+  PWM_Callback = nullptr;
+  
+  switch(parameters.CHANNEL_NUM)
+  {
     case 1:
       EXTI_Callback = _calcInput_CH1;
+      STALL_Callback = _stallInput_CH1;
+      PWM_Callback = _pwmInput_CH1;
     break;
     case 2:
       EXTI_Callback = _calcInput_CH2;
+      STALL_Callback = _stallInput_CH2;
+      PWM_Callback = _pwmInput_CH2;
     break;
     case 3:
       EXTI_Callback = _calcInput_CH3;
+      STALL_Callback = _stallInput_CH3;
+      PWM_Callback = _pwmInput_CH3;
     break;	
   }
 
@@ -299,17 +1794,313 @@ bool TachometerOptical::init(void)
   return true;
 }
 
+void TachometerOptical::_edgeHandler(uint32_t tNow)
+{
+  _rawEdge(tNow);
+
+  if(parameters.EDGE_MODE != EdgeMode::BOTH)
+  {
+    uint32_t count = _rawEdgeCount;
+    uint32_t last = _edgeRing[(count - 1) & (TACHOMETER_OPTICAL_EDGE_RING_SIZE - 1)];
+    uint32_t period = tNow - last;
+    uint32_t prevPeriod = last - _edgeRing[(count - 2) & (TACHOMETER_OPTICAL_EDGE_RING_SIZE - 1)];
+    _edgeRing[count & (TACHOMETER_OPTICAL_EDGE_RING_SIZE - 1)] = tNow;
+    _rawEdgeCount = count + 1;
+
+    if(_warmup == TachometerOptical_Core::WarmupState::WAIT_FIRST_EDGE)
+    {
+      // The prediction and the tooth pattern restart with the warm-up.
+      _classifier.expected = 0;
+      _classifier.fragment = 0;
+      _classifier.last = TachometerOptical_Core::PulseClass::NORMAL;
+      TachometerOptical_Core::resetToothDecoder(_toothDecoder);
+      _recordEdge(tNow, tNow - _startPeriod, true);
+      return;
+    }
+
+    if(_toothDecoderEnabled == true)
+    {
+      uint8_t pulses;
+      TachometerOptical_Core::ToothEvent event = TachometerOptical_Core::decodeTooth(_toothDecoder, period, prevPeriod, pulses);
+
+      if(event == TachometerOptical_Core::ToothEvent::UNLOCKED)
+      {
+        if(_warmup > TachometerOptical_Core::WarmupState::WAIT_SECOND_EDGE)
+        {
+          // Sync loss: the RPM values are 0 until the decoder locks again.
+          _warmup = TachometerOptical_Core::WarmupState::WAIT_SECOND_EDGE;
+        }
+        _recordEdge(tNow, period, false);
+        return;
+      }
+
+      _setPulsesPerRevolution(_toothDecoder.pulsesPerRevolution);
+      // The gap period has pulses tooth periods.
+      _recordEdge(tNow, (pulses > 1) ? period / pulses : period, true, pulses, event == TachometerOptical_Core::ToothEvent::INDEX);
+
+      if( (event == TachometerOptical_Core::ToothEvent::INDEX) && (_indexCallback != nullptr) )
+      {
+        _indexCallback(parameters.CHANNEL_NUM);
+      }
+      return;
+    }
+
+    if(_classifier.tolerance == 0)
+    {
+      _recordEdge(tNow, period, true);
+      return;
+    }
+
+    uint8_t pulses;
+    TachometerOptical_Core::PulseClass lastClass = _classifier.last;
+    uint8_t lastCorrection = _classifier.lastCorrection;
+
+    if(TachometerOptical_Core::classifyPulse(_classifier, period, period, pulses) == TachometerOptical_Core::PulseClass::RESYNC)
+    {
+      // The last correction was a speed step. Its pulses are restored in the pulse total and the angle.
+      if(lastClass == TachometerOptical_Core::PulseClass::EXTRA)
+      {
+        pulses += lastCorrection;
+      }
+      else if(lastClass == TachometerOptical_Core::PulseClass::MISSING)
+      {
+        _undoPulses(lastCorrection);
+      }
+    }
+
+    if(pulses > 0)
+    {
+      _recordEdge(tNow, period, true, pulses);
+    }
+    return;
+  }
+
+  // The pin level after the edge gives the edge type. The period is measured between edges of the same type.
+  uint8_t level = ((parameters.GPIO_PORT->IDR & parameters.GPIO_PIN) != 0) ? 1 : 0;
+
+  if(_warmup == TachometerOptical_Core::WarmupState::WAIT_FIRST_EDGE)
+  {
+    _edgeSeen = 0;
+  }
+
+  bool complete = ((_edgeSeen >> level) & 1) != 0;
+  uint32_t period = tNow - _edgeTime[level];
+
+  if( (level == 0) && ((_edgeSeen & 2) != 0) && (complete == true) )
+  {
+    // Falling edge: the mark started at the last rising edge.
+    _width = tNow - _edgeTime[1];
+    _widthPeriod = period;
+  }
+
+  _edgeSeen |= (uint8_t)(1 << level);
+  _edgeTime[level] = tNow;
+
+  // Both edges update the speed. Only rising edges count as pulses, so the pulse based values run at the mark rate.
+  _recordEdge(tNow, period, complete, level);
+}
+
+void TachometerOptical::_pwmHandler(void)
+{
+  uint32_t tNow = _TIMER->micros();
+
+  _rawEdge(tNow);
+
+  // Reset slave mode: CCR1 is the period and CCR2 is the mark width. 1 tick = 1 us.
+  uint32_t period = __HAL_TIM_GET_COMPARE(parameters.PWM_TIMER, TIM_CHANNEL_1);
+  _width = __HAL_TIM_GET_COMPARE(parameters.PWM_TIMER, TIM_CHANNEL_2);
+  _widthPeriod = period;
+
+  _recordEdge(tNow, period, true);
+}
+
+void TachometerOptical::_rawEdge(uint32_t tNow)
+{
+  if(_edgeSink != nullptr)
+  {
+    _edgeSink(_edgeSinkContext, parameters.CHANNEL_NUM, tNow);
+  }
+
+  if( (_capture.buffer != nullptr) && (_captureFrozen == false) )
+  {
+    TachometerOptical_Core::captureEdge(_capture, tNow);
+  }
+
+  if(_trigger.buffer != nullptr)
+  {
+    TachometerOptical_Core::triggerEdge(_trigger, tNow);
+  }
+}
+
+void TachometerOptical::_undoPulses(uint8_t pulses)
+{
+  uint32_t count = _edgeCount;
+  _edgeCount = count - pulses;
+  // Borrow from the high word of the pulse total.
+  _edgeCountHigh -= (uint32_t)(count < pulses);
+
+  if(_angle.marks > 0)
+  {
+    TachometerOptical_Core::angleUndo(_angle.state, _angle.marks, _angle.useIndex, pulses);
+    _angleSnapshot.write(_angle.state);
+  }
+}
+
+void TachometerOptical::_recordEdge(uint32_t tNow, uint32_t period, bool complete, uint8_t pulses, bool toothIndex)
+{
+  uint32_t elapsed = tNow - _startPeriod;
+  _startPeriod = tNow;
+
+  uint32_t count = _edgeCount + pulses;
+  _edgeCount = count;
+  // Carry to the high word of the pulse total. It is a compare and an add, without a branch.
+  _edgeCountHigh += (uint32_t)(count < pulses);
+
+  if(_watchdog.htim != nullptr)
+  {
+    // Re-arm the stall watchdog at lastEdge + timeout.
+    uint32_t tick = __HAL_TIM_GET_COUNTER(_watchdog.htim);
+    _watchdog.lastEdgeTick = tick;
+    __HAL_TIM_SET_COMPARE(_watchdog.htim, _watchdog.channel, (tick + _watchdog.timeout) & _watchdog.mask);
+
+    if(_stalled == true)
+    {
+      _stalled = false;
+      __HAL_TIM_CLEAR_FLAG(_watchdog.htim, _watchdog.interrupt);
+      __HAL_TIM_ENABLE_IT(_watchdog.htim, _watchdog.interrupt);
+    }
+  }
+
+  TachometerOptical_Core::WarmupState warmup = _warmup;
+  // An incomplete period does not advance the warm-up, except the first edge that starts it.
+  bool valid = ( (complete == true) || (warmup == TachometerOptical_Core::WarmupState::WAIT_FIRST_EDGE) ) && TachometerOptical_Core::warmupEdge(warmup);
+  _warmup = warmup;
+
+  // Period of one revolution for the RPM values. The angle estimator uses the pulse period.
+  // It saturates, so a long period with many pulses per revolution is below the min RPM instead of wrapping to a high RPM.
+  uint64_t fullPeriod = (uint64_t)period * _pulsesPerRevolution;
+  uint32_t revolutionPeriod = (fullPeriod > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)fullPeriod;
+
+  TachometerOptical_Core::edgeState(_edgeState, tNow, revolutionPeriod, valid);
+  _edgeSnapshot.write(_edgeState);
+
+  // The tooth positions are not known while the missing-tooth decoder is not locked.
+  if( (_angle.marks > 0) && (pulses > 0) && ( (_toothDecoderEnabled == false) || (_toothDecoder.locked == true) ) )
+  {
+    bool index = _indexPending || toothIndex;
+    _indexPending = false;
+    for(uint8_t i = 1; i < pulses; i++)
+    {
+      // Corrected missing pulses pass their marks without an index.
+      TachometerOptical_Core::angleEdge(_angle.state, _angle.marks, _angle.useIndex, false, tNow, period, valid);
+    }
+    TachometerOptical_Core::angleEdge(_angle.state, _angle.marks, _angle.useIndex, index, tNow, period, valid);
+    _angleSnapshot.write(_angle.state);
+  }
+
+  if(valid == false)
+  {
+    // The first edge after init() or a stall only starts a period.
+    if(pulses > 0)
+    {
+      _notify(WAIT_REVOLUTION);
+    }
+    return;
+  }
+
+  _period = revolutionPeriod;
+
+  if(_histogram.bins != nullptr)
+  {
+    // The time from the last edge is spent at this speed.
+    TachometerOptical_Core::histogramAdd(_histogram, revolutionPeriod, elapsed);
+  }
+
+  if(pulses == 0)
+  {
+    // Speed only edge. The threshold debounce counts pulses.
+    return;
+  }
+
+  // One integer compare per threshold: the trip limit when not tripped, the release limit when tripped.
+  _thresholdHandler(_overspeed, _overspeed.state ? (revolutionPeriod > _overspeed.releasePeriod) : (revolutionPeriod < _overspeed.tripPeriod), ThresholdEvent::OVERSPEED_TRIP);
+  _thresholdHandler(_underspeed, _underspeed.state ? (revolutionPeriod < _underspeed.releasePeriod) : (revolutionPeriod > _underspeed.tripPeriod), ThresholdEvent::UNDERSPEED_TRIP);
+
+  _notify(WAIT_REVOLUTION);
+}
+
+void TachometerOptical::_stallHandler(void)
+{
+  if( (_watchdog.htim == nullptr) || (_stalled == true) )
+  {
+    return;
+  }
+
+  // An edge may re-arm the compare just before this interrupt is served. Check the real elapsed time.
+  uint32_t elapsed = (__HAL_TIM_GET_COUNTER(_watchdog.htim) - _watchdog.lastEdgeTick) & _watchdog.mask;
+  if(elapsed < _watchdog.timeout)
+  {
+    return;
+  }
+
+  __HAL_TIM_DISABLE_IT(_watchdog.htim, _watchdog.interrupt);
+
+  _stalled = true;
+  _warmup = TachometerOptical_Core::WarmupState::WAIT_FIRST_EDGE;
+  value.rawRPM = 0;
+  value.RPM = 0;
+  value.duty = 0;
+
+  if(_triggerCondition.stall == true)
+  {
+    // The edge interrupt can preempt this interrupt and must not run triggerEdge() during the slot switch.
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    TachometerOptical_Core::triggerFire(_trigger, TachometerOptical_Core::TriggerEvent::STALL, _TIMER->micros());
+    __set_PRIMASK(primask);
+  }
+
+  if(_stallCallback != nullptr)
+  {
+    _stallCallback(parameters.CHANNEL_NUM);
+  }
+}
+
+void TachometerOptical::_thresholdHandler(ThresholdStructure &threshold, bool cross, ThresholdEvent tripEvent)
+{
+  if(cross == false)
+  {
+    threshold.counter = 0;
+    return;
+  }
+
+  if(++threshold.counter < threshold.debounce)
+  {
+    return;
+  }
+
+  threshold.counter = 0;
+  threshold.state = !threshold.state;
+
+  if(_thresholdCallback != nullptr)
+  {
+    // Release event always follows its trip event in ThresholdEvent.
+    ThresholdEvent event = threshold.state ? tripEvent : (ThresholdEvent)((uint8_t)tripEvent + 1);
+    _thresholdCallback(parameters.CHANNEL_NUM, event);
+  }
+}
+
 bool TachometerOptical::_checkParameters(void)
 {
   if( (parameters.CHANNEL_NUM > 3) || (parameters.CHANNEL_NUM == 0) )
   {
-    errorMessage = "Error TachometerOptical: channel number is not correct.";
+    errorCode = ErrorCode::CHANNEL_INVALID;
     return false;
   }
 
   if (_instances[parameters.CHANNEL_NUM - 1] != nullptr) 
   {
-    errorMessage = "Error TachometerOptical: The channel number is used for another object. please select another channel.";
+    errorCode = ErrorCode::CHANNEL_IN_USE;
     return false;;
 
     /*
@@ -319,19 +2110,19 @@ bool TachometerOptical::_checkParameters(void)
     */
   }
 
-  bool state = (TachometerOptical::_FILTER_FRQ >= 0) && (TachometerOptical::_UPDATE_FRQ >= 0) &&
-               (parameters.GPIO_PORT != nullptr) && (parameters.CHANNEL_NUM >= 1) && (parameters.CHANNEL_NUM <= 3) &&
-               (TachometerOptical::_MAX >= TachometerOptical::_MIN) && (TachometerOptical::_TIMER != nullptr) ;
+  bool state = (TachometerOptical::_config.FILTER_FRQ >= 0) && (TachometerOptical::_config.UPDATE_FRQ >= 0) &&
+               ( (parameters.GPIO_PORT != nullptr) || (parameters.PWM_TIMER != nullptr) ) && (parameters.CHANNEL_NUM >= 1) && (parameters.CHANNEL_NUM <= 3) &&
+               (TachometerOptical::_config.MAX >= TachometerOptical::_config.MIN) && (TachometerOptical::_TIMER != nullptr) ;
 
   if(state == false)
   {
-    errorMessage = "Error TachometerOptical: One or some parameters is not correct.";
+    errorCode = ErrorCode::PARAMETERS_INVALID;
     return false;
   }
 
   if(TachometerOptical::_TIMER->getInitState() == false)
   {
-    errorMessage = "Error TachometerOptical: The TimerControl object must be initialized successfully before the TachometerOptical object.";
+    errorCode = ErrorCode::TIMER_NOT_INITIALIZED;
     return false;
   }
 
@@ -19,6 +19,12 @@
 // #define STM32F4
 // #define STM32H7
 
+// Optional: select the RTOS used by waitForMeasurement()/waitForRevolution().
+// If none of them is defined, a bare-metal WFE loop is used.
+
+// #define TACHOMETER_OPTICAL_FREERTOS
+// #define TACHOMETER_OPTICAL_CMSIS_RTOS2
+
 // ----------------------------------------------------------------
 // ##################################################################
 // Library information:
@@ -39,12 +45,29 @@ For more information read README.md file.
 #error "Unsupported MCU family. Please define a valid target (e.g., STM32F1, STM32F4, STM32H7)."
 #endif
 
-#include <string>               // Include the standard string library for error handling and messages
 #include "TimerControl.h"
+#include "TachometerOpticalCore.h"
+
+#if defined(TACHOMETER_OPTICAL_FREERTOS)
+#include "FreeRTOS.h"           // FreeRTOS kernel. Task notifications are used for waiting.
+#include "task.h"
+#elif defined(TACHOMETER_OPTICAL_CMSIS_RTOS2)
+#include "cmsis_os2.h"          // CMSIS-RTOS2 API. Event flags are used for waiting.
+#endif
 
 // ####################################################################
 // Define Global macros:
 
+/**
+ * @brief Size of the per-channel ring of raw edge timestamps. It must be a power of 2.
+ * @note - It can be defined in mcu_select.h or by the compiler options.
+ */
+#ifndef TACHOMETER_OPTICAL_EDGE_RING_SIZE
+#define TACHOMETER_OPTICAL_EDGE_RING_SIZE     16
+#endif
+
+static_assert( (TACHOMETER_OPTICAL_EDGE_RING_SIZE >= 4) && ((TACHOMETER_OPTICAL_EDGE_RING_SIZE & (TACHOMETER_OPTICAL_EDGE_RING_SIZE - 1)) == 0), 
+               "TACHOMETER_OPTICAL_EDGE_RING_SIZE must be a power of 2 and at least 4.");
 
 // ###################################################################################
 //  General function declarations:
@@ -54,6 +77,102 @@ namespace TachometerOptical_Namespace
   void _calcInput_CH1(void);       /// @brief Interrupt handler function for TachometerOptical channel 1.
   void _calcInput_CH2(void);       /// @brief Interrupt handler function for TachometerOptical channel 2.
   void _calcInput_CH3(void);       /// @brief Interrupt handler function for TachometerOptical channel 3.
+
+  void _stallInput_CH1(void);      /// @brief Stall watchdog compare interrupt handler function for TachometerOptical channel 1.
+  void _stallInput_CH2(void);      /// @brief Stall watchdog compare interrupt handler function for TachometerOptical channel 2.
+  void _stallInput_CH3(void);      /// @brief Stall watchdog compare interrupt handler function for TachometerOptical channel 3.
+
+  void _pwmInput_CH1(void);        /// @brief PWM input capture interrupt handler function for TachometerOptical channel 1.
+  void _pwmInput_CH2(void);        /// @brief PWM input capture interrupt handler function for TachometerOptical channel 2.
+  void _pwmInput_CH3(void);        /// @brief PWM input capture interrupt handler function for TachometerOptical channel 3.
+
+  /**
+   * @brief Error messages table. 
+   * @note - The order of messages must match the order of TachometerOptical::ErrorCode values.
+   */
+  constexpr const char* const _ERROR_MESSAGES[] = 
+  {
+    "No error.",
+    "Error TachometerOptical: channel number is not correct.",
+    "Error TachometerOptical: The channel number is used for another object. please select another channel.",
+    "Error TachometerOptical: One or some parameters is not correct.",
+    "Error TachometerOptical: The TimerControl object pointer can not be nullptr.",
+    "Error TachometerOptical: The TimerControl object must be initialized successfully before the TachometerOptical object.",
+    "Error TachometerOptical: The GPIO_PIN parameter is not correct.",
+    "Error TachometerOptical: The max RPM parameter value can not be less than The min RPM parameter value.",
+    "Error TachometerOptical:: The update frequency parameter value can not be less than 0.",
+    "Error TachometerOptical: The filter frequency parameter value can not be less than 0.",
+    "Error TachometerOptical: The threshold parameter values are not correct.",
+    "Error TachometerOptical: The stall watchdog parameter values are not correct."
+  };
+
+  /// @brief Number of messages in the error messages table.
+  constexpr uint8_t _ERROR_MESSAGES_NUM = sizeof(_ERROR_MESSAGES) / sizeof(_ERROR_MESSAGES[0]);
+
+  /// @brief Check word key of the pulse total backup. A cleared or random backup memory does not match it.
+  constexpr uint32_t _TOTAL_CHECK = 0x5A17C0DEu;
+
+  /**
+   * @class DoubleBuffer
+   * @brief Single writer, multi reader double buffer with a generation counter.  
+   * The writer fills the buffer that readers are not using and then publishes it. It is never blocked.  
+   * Readers in any context (main loop, RTOS tasks, other interrupts) get a coherent copy without locks. 
+   * They retry only if the writer published twice during the copy.
+   */
+  template <typename T>
+  class DoubleBuffer
+  {
+    public:
+
+      DoubleBuffer() : _begin(0), _sequence(0) {}
+
+      /**
+       * @brief Publish new data. Only one context may write to the object.
+       */
+      void write(const T &data)
+      {
+        uint32_t next = _sequence + 1;
+        _begin = next;
+        __DMB();
+        _buffer[next & 1] = data;
+        __DMB();
+        _sequence = next;
+      }
+
+      /**
+       * @brief Copy the last published data.
+       * @return The generation number of the copied data. A value of 0 means nothing is published yet.
+       */
+      uint32_t read(T &data) const
+      {
+        uint32_t sequence;
+
+        do
+        {
+          sequence = _sequence;
+          __DMB();
+          data = _buffer[sequence & 1];
+          __DMB();
+        // The copied buffer is overwritten only when the writer started the generation after the next one.
+        }while((uint32_t)(_begin - sequence) >= 2);
+
+        return sequence;
+      }
+
+      /// @brief Return the generation number of the last published data. A value of 0 means nothing is published yet.
+      uint32_t getSequence(void) const {return _sequence;};
+
+    private:
+
+      /// @brief Data buffers. The last published data is in _buffer[_sequence & 1].
+      T _buffer[2];
+
+      /// @brief Generation number that the writer started to write.
+      volatile uint32_t _begin;
+
+      /// @brief Generation number of the last published data.
+      volatile uint32_t _sequence;
+  };
 }
 
 // ##################################################################################3
@@ -67,8 +186,67 @@ class TachometerOptical
 {
   public:
 
+    /**
+     * @enum ErrorCode
+     * @brief Error codes of TachometerOptical objects.
+     */
+    enum class ErrorCode : uint8_t
+    {
+      NONE = 0,                     ///< No error.
+      CHANNEL_INVALID,              ///< Channel number is not 1, 2 or 3.
+      CHANNEL_IN_USE,               ///< Channel number is used for another object.
+      PARAMETERS_INVALID,           ///< One or some parameters is not correct.
+      TIMER_NULL,                   ///< TimerControl object pointer is nullptr.
+      TIMER_NOT_INITIALIZED,        ///< TimerControl object is not initialized.
+      GPIO_PIN_INVALID,             ///< GPIO_PIN parameter is not correct.
+      RANGE_INVALID,                ///< Max RPM value is less than min RPM value.
+      UPDATE_FREQUENCY_INVALID,     ///< Update frequency value is less than 0.
+      FILTER_FREQUENCY_INVALID,     ///< Filter frequency value is less than 0.
+      THRESHOLD_INVALID,            ///< Overspeed/underspeed threshold values are not correct.
+      WATCHDOG_INVALID              ///< Stall watchdog values are not correct.
+    };
+
+    /**
+     * @enum ThresholdEvent
+     * @brief Events reported by overspeed/underspeed threshold callbacks.
+     */
+    enum class ThresholdEvent : uint8_t
+    {
+      OVERSPEED_TRIP = 0,           ///< RPM rose above the overspeed trip value.
+      OVERSPEED_RELEASE,            ///< RPM fell below the overspeed release value.
+      UNDERSPEED_TRIP,              ///< RPM fell below the underspeed trip value.
+      UNDERSPEED_RELEASE            ///< RPM rose above the underspeed release value.
+    };
+
+    /**
+     * @enum EdgeMode
+     * @brief Signal edges used for the measurement.
+     */
+    enum class EdgeMode : uint8_t
+    {
+      RISING = 0,                   ///< Rising edges only.
+      FALLING,                      ///< Falling edges only.
+      BOTH                          ///< Rising and falling edges. A full period is measured on every edge and the mark (high level) width is measured.
+    };
+
     /// @brief Last error accured for object.
-    static std::string errorMessage;
+    ErrorCode errorCode;
+
+    /**
+     * @brief Last error accured for static configuration methods. eg: setRange(), setTimerControl().
+     * @note - This value is static and shared by all TachometerOptical objects.
+     */
+    static ErrorCode sharedErrorCode;
+
+    /**
+     * @brief Get the error message string for an error code.
+     * @note - The returned string is stored in flash memory and no heap allocation is used.
+     * @return Pointer to a null terminated string.
+     */
+    static constexpr const char* errorString(ErrorCode code)
+    {
+      return ((uint8_t)code < TachometerOptical_Namespace::_ERROR_MESSAGES_NUM) ? TachometerOptical_Namespace::_ERROR_MESSAGES[(uint8_t)code] : "Error TachometerOptical: Unknown error.";
+    }
 
     /**
       @struct ParametersStructure
@@ -92,6 +270,31 @@ class TachometerOptical
        *  */ 
       uint8_t CHANNEL_NUM;											
 
+      /**
+       * @brief Signal edges used for the measurement. Default value: EdgeMode::RISING.
+       * @note - EdgeMode::BOTH doubles the sample rate and measures the mark width and duty cycle.
+       */
+      EdgeMode EDGE_MODE;
+
+      /**
+       * @brief Timer handle for the PWM input capture path. A value of nullptr means the GPIO EXTI path is used. Default value: nullptr.
+       * @note - The timer must be configured outside of the object in PWM input mode: reset slave mode on TI1FP1, CH1 direct on rising edges
+       * and CH2 indirect on falling edges. CCR1 is the period and CCR2 is the mark width, so no ISR arithmetic is needed.
+       * @note - The timer must count at 1 MHz (1 tick = 1 us). Use a 32-bit timer for periods above 65535 us.
+       * @note - Start it with HAL_TIM_IC_Start_IT(htim, TIM_CHANNEL_1) and HAL_TIM_IC_Start(htim, TIM_CHANNEL_2). 
+       * Call PWM_Callback in HAL_TIM_IC_CaptureCallback() for this timer and channel 1.
+       * @note - GPIO_PORT, GPIO_PIN and EDGE_MODE are not used with this path.
+       */
+      TIM_HandleTypeDef *PWM_TIMER;
+
+      /**
+       * @brief NVIC preemption priority of the EXTI interrupt set by init(). Default value: 0 (highest).
+       * @note - With TACHOMETER_OPTICAL_FREERTOS or TACHOMETER_OPTICAL_CMSIS_RTOS2 it must be an interrupt priority that can call RTOS API 
+       * (FreeRTOS: numerically greater than or equal to configMAX_SYSCALL_INTERRUPT_PRIORITY >> (8 - __NVIC_PRIO_BITS)).
+       * @note - EXTI lines 5-9 and 10-15 share one interrupt. The last init() sets its priority.
+       */
+      uint8_t INTERRUPT_PRIORITY;
+
     }parameters;
 
     /**
@@ -106,16 +309,198 @@ class TachometerOptical
       /// @brief RPM value after low-pass filter and MIN/MAX saturation. [RPM].
       float RPM;
 
+      /// @brief Duty cycle of the mark (high level). [%] It is 0 if the mark width is not measured. (EdgeMode::BOTH or PWM_TIMER)
+      float duty;
+
       /// @brief RPM value updated by all TachometerOptical objects.  
       static float sharedRPM;		
     }value;
 
+    /**
+      @struct MeasurementStructure
+      @brief Coherent snapshot of the channel results published by update().
+    */ 
+    struct MeasurementStructure
+    {
+      /// @brief RPM value after low-pass filter and MIN/MAX saturation. [RPM].
+      float RPM;
+
+      /// @brief Raw input RPM signal measurement value. [RPM].
+      float rawRPM;
+
+      /// @brief Period time value used for the measurement. [us]
+      uint32_t period;
+
+      /// @brief Time of the last edge used for the measurement. [us]
+      uint32_t timestamp;
+
+      /// @brief Last mark (high level) width. [us] It is 0 if it is not measured.
+      uint32_t width;
+
+      /// @brief Duty cycle of the mark (high level). [%]
+      float duty;
+
+      /// @brief Generation number of the measurement. It increases by one on every update() of the channel.
+      uint32_t sequence;
+    };
+
+    /**
+      @struct ChannelSnapshotStructure
+      @brief Speed estimate of one channel in a snapshot.
+    */ 
+    struct ChannelSnapshotStructure
+    {
+      /// @brief Unfiltered RPM estimate at the snapshot time, interpolated or extrapolated from the last two periods. [RPM]
+      float RPM;
+
+      /// @brief Age of the underlying data: snapshot time minus the last edge time. It is negative if the last edge is after the snapshot time. [us]
+      int32_t age;
+
+      /// @brief true if the channel is attached and has a valid period. false means RPM is 0.
+      bool valid;
+    };
+
+    /**
+      @struct SnapshotStructure
+      @brief Speed estimates of all channels at a common time.
+    */ 
+    struct SnapshotStructure
+    {
+      /// @brief Snapshot time. [us]
+      uint32_t timestamp;
+
+      /// @brief Channel values. Cell 0 is for channel 1. Cell 1 is for channel 2. Cell 2 is for channel 3.
+      ChannelSnapshotStructure channel[3];
+    };
+
+    /**
+      @struct AngleStructure
+      @brief Shaft angle estimate.
+    */ 
+    struct AngleStructure
+    {
+      /// @brief Number of complete revolutions since init(). It is counted by the index pulse if it is used.
+      int32_t revolutions;
+
+      /// @brief Angle in the revolution interpolated between mark edges. 0 ... 1. [revolution]
+      float angle;
+
+      /// @brief true if the angle is interpolated from a valid period. false means angle is only the last mark position.
+      bool valid;
+    };
+
+    /**
+      @struct ToothStructure
+      @brief Missing-tooth decoder state.
+    */ 
+    struct ToothStructure
+    {
+      /// @brief true if the decoder is locked to the gap pattern.
+      bool locked;
+
+      /// @brief Detected tooth positions in one revolution. Real teeth + missing teeth. eg: 36 for a 36-1 wheel.
+      uint16_t pulsesPerRevolution;
+
+      /// @brief Detected missing teeth in the gap. eg: 1 for a 36-1 wheel.
+      uint8_t missingTeeth;
+
+      /// @brief Tooth number of the last edge. 0 is the first tooth after the gap (index).
+      uint16_t tooth;
+
+      /// @brief Number of locked revolutions since init().
+      uint32_t revolutions;
+
+      /// @brief Number of sync losses since init().
+      uint32_t syncLoss;
+    };
+
+    /**
+     * @brief Edge sink function type. It is called in the edge interrupt.
+     * @param context is the pointer given to setEdgeSink().
+     * @param timestamp is the raw edge time. [us]
+     */
+    typedef void (*EdgeSinkPtr)(void *context, uint8_t channel, uint32_t timestamp);
+
+    /**
+     * @brief Define resampler block callback function pointer type.
+     * @param channel is the channel number of the object.
+     * @param block is the block of uniform speed samples. [RPM] It is valid until the next callback of the channel.
+     * @param size is the number of samples. It is less than the block size only for the last block before a stream restart.
+     * @param timestamp is the time of the first sample. [us]
+     */
+    typedef void (*BlockCallbackPtr)(uint8_t channel, const float *block, uint16_t size, uint32_t timestamp);
+
+    /**
+      @struct OrderConfigStructure
+      @brief Order tracking configuration.
+    */ 
+    struct OrderConfigStructure
+    {
+      /// @brief Number of output samples per revolution.
+      uint16_t samplesPerRevolution;
+
+      /// @brief Number of marks per revolution. It is not used when the missing-tooth decoder is enabled.
+      uint16_t marks;
+
+      /// @brief ADC buffer that is filled by a circular DMA. A value of nullptr means the order tracking is disabled.
+      const volatile uint16_t *adcBuffer;
+
+      /// @brief Number of samples of the ADC buffer.
+      uint32_t adcSize;
+
+      /// @brief DMA handle of the ADC buffer. Its counter gives the write position.
+      DMA_HandleTypeDef *hdma;
+
+      /// @brief ADC sample rate. [Hz] The ADC must be triggered by a timer at this rate.
+      float adcRate;
+
+      /// @brief Block buffer of 2 * blockSize values. The callback gets one half while the other half is filled.
+      float *buffer;
+
+      /// @brief Number of samples of a block. eg: samplesPerRevolution for one revolution per block.
+      uint16_t blockSize;
+
+      /// @brief Block callback function. It is called in the update() context with the time of the first sample of the block.
+      BlockCallbackPtr callback;
+    };
+
     /// @brief Define function pointer type
     typedef void (*FunctionPtr)();
 
     /// @brief FunctionPtr object for signals interrupts handler.
     FunctionPtr EXTI_Callback;
 
+    /**
+     * @brief Define threshold callback function pointer type.
+     * @param channel is the channel number of the object that fired the event.
+     * @param event is the threshold event.
+     */
+    typedef void (*ThresholdCallbackPtr)(uint8_t channel, ThresholdEvent event);
+
+    /**
+     * @brief Define stall callback function pointer type.
+     * @param channel is the channel number of the object that stalled.
+     */
+    typedef void (*StallCallbackPtr)(uint8_t channel);
+
+    /**
+     * @brief Define index callback function pointer type.
+     * @param channel is the channel number of the object that received the index.
+     */
+    typedef void (*IndexCallbackPtr)(uint8_t channel);
+
+    /**
+     * @brief FunctionPtr object for stall watchdog compare interrupt handler.
+     * @note - Call it in HAL_TIM_OC_DelayElapsedCallback() for the watchdog timer and channel.
+     */
+    FunctionPtr STALL_Callback;
+
+    /**
+     * @brief FunctionPtr object for PWM input capture interrupt handler. 
+     * @note - Call it in HAL_TIM_IC_CaptureCallback() for parameters.PWM_TIMER and channel 1.
+     */
+    FunctionPtr PWM_Callback;
+
     /**
     * @brief Default constructor. Init default value of variables and parameters.
     */
@@ -135,6 +520,21 @@ class TachometerOptical
      */
     static void update(void);
 
+    /**
+     * @brief Get the speed estimates of all channels at a common time, so the values of different shafts can be compared.
+     * @param timestamp is the snapshot time in the TimerControl micros() time base. [us]
+     * @note - It costs O(channels) with no locks and no interrupt disabling, so it can be called from a high rate control interrupt.
+     * @note - The estimates are based on the edge data, not on update(). They are not low-pass filtered.
+     * @return true if successful. false if the TimerControl object is not set.
+     */
+    static bool getSnapshot(uint32_t timestamp, SnapshotStructure &snapshot);
+
+    /**
+     * @brief Get the speed estimates of all channels at the current time.
+     * @return true if successful. false if the TimerControl object is not set.
+     */
+    static bool getSnapshot(SnapshotStructure &snapshot);
+
     /**
      * @brief Set RPM acceptable value range.
      * @return true if successful.
@@ -144,6 +544,8 @@ class TachometerOptical
     /**
      * @brief Set The RPM update frequency. [Hz]
      * @note - This value ensures that RPM filtered values are updated at a certain frequency.
+     * @note - If it is not 0, the low-pass filter gain is precomputed at the nominal interval 1 / value. It is not corrected for 
+     * late update() calls. If it is 0, the gain is calculated from the measured time of every update().
      * @note - A value of 0 means it is disabled.
      * @note - This parameter is static and applies globally to all TachometerOptical objects.
      */
@@ -151,11 +553,22 @@ class TachometerOptical
 
     /**
      * @brief Set the RPM Low pass filter frequency(Cutoff filter frequency). [Hz].
+     * @note - With an update frequency the filter gain uses the nominal update interval. Read setUpdateFrequency() notes.
      * @note - A value of 0 means it is disabled.
      * @note - This parameter is static and applies globally to all TachometerOptical objects.
      */
     static bool setFilterFrequency(float value);
 
+    /**
+     * @brief Set the RPM range, update frequency and filter frequency at once from a precomputed configuration.
+     * @note - Create the configuration with TachometerOptical_Core::makeFilterConfig(). For products with build time fixed values 
+     * make it constexpr, so the filter gain, update interval and MIN/MAX period bounds are calculated by the compiler.
+     * @note - The runtime setters setRange(), setUpdateFrequency() and setFilterFrequency() compute the same values once when they are called.
+     * @note - This parameter is static and applies globally to all TachometerOptical objects.
+     * @return true if successful.
+     */
+    static bool setFilterConfig(const TachometerOptical_Core::FilterConfigStructure &config);
+
     /**
      * @brief Set the TimerControl object pointer.
      * @note - Set this timer carefully because the object calculate RPM by this timer.
@@ -166,8 +579,754 @@ class TachometerOptical
      */
     static bool setTimerControl(TimerControl* timer);
 
+    /**
+     * @brief Set the edge sink function. It is called in the edge interrupt with the raw edge time of every channel.
+     * @param sink is the function. A value of nullptr means it is disabled.
+     * @param context is the pointer given to the sink function.
+     * @note - This parameter is static and applies globally to all TachometerOptical objects.
+     */
+    static void setEdgeSink(EdgeSinkPtr sink, void *context);
+
+    /**
+     * @brief Set the telemetry object that streams the raw edge timestamps of all channels. It is an edge sink.
+     * @note - The TachometerTelemetry object must be initialized outside of the object.
+     * @note - TachometerTelemetry.cpp is only needed at link time if this method is used.
+     * @note - This parameter is static and applies globally to all TachometerOptical objects.
+     */
+    template <class Telemetry>
+    static void setTelemetry(Telemetry* telemetry)
+    {
+      setEdgeSink( (telemetry != nullptr) ? &_telemetrySink<Telemetry> : nullptr, telemetry);
+    }
+
+    /// @brief Disable the telemetry.
+    static void setTelemetry(decltype(nullptr)) {setEdgeSink(nullptr, nullptr);};
+
+    /**
+     * @brief Set overspeed threshold. It is checked in the edge interrupt on every pulse.
+     * @param tripRPM is the RPM value that the overspeed state is set above it. A value of 0 means it is disabled.
+     * @param releaseRPM is the RPM value that the overspeed state is cleared below it. (hysteresis) A value of 0 latches the state.
+     * @param debounce is the number of consecutive pulses that must cross the limit before the event fires.
+     * @note - The RPM values are converted to period limits here, so the interrupt only does integer compares.
+     * @return true if successful.
+     */
+    bool setOverspeedThreshold(float tripRPM, float releaseRPM, uint8_t debounce = 1);
+
+    /**
+     * @brief Set underspeed threshold. It is checked in the edge interrupt on every pulse.
+     * @param tripRPM is the RPM value that the underspeed state is set below it. A value of 0 means it is disabled.
+     * @param releaseRPM is the RPM value that the underspeed state is cleared above it. (hysteresis)
+     * @param debounce is the number of consecutive pulses that must cross the limit before the event fires.
+     * @note - Underspeed is detected only when pulses arrive. A stopped shaft produces no pulses.
+     * @return true if successful.
+     */
+    bool setUnderspeedThreshold(float tripRPM, float releaseRPM, uint8_t debounce = 1);
+
+    /**
+     * @brief Set the threshold callback function. It is called in the edge interrupt context.
+     * @note - A value of nullptr means it is disabled.
+     */
+    void setThresholdCallback(ThresholdCallbackPtr callback);
+
+    /**
+     * @brief Set the speed-proportional (adaptive) low-pass filter for this channel.  
+     * The cutoff frequency follows the measured pulse rate, so the smoothing is a fixed number of revolutions at any speed:
+     * low lag at high speed where samples are dense and enough smoothing at low speed where samples are sparse.
+     * @param revolutions is the filter time constant. [revolutions] A value of 0 means it is disabled and the 
+     * global filter frequency (setFilterFrequency()) is used.
+     * @note - The filter gain is taken from a precomputed table of powers, so no division is done in update().
+     * @return true if successful.
+     */
+    bool setAdaptiveFilter(float revolutions);
+
+    /**
+     * @brief Set the missing and extra pulse classifier. Each edge period is classified against the predicted period in the edge interrupt:  
+     * about n times means missed pulses and the period is split, a short period that sums with the next one to the predicted period 
+     * means an extra pulse and they are merged.
+     * @param tolerance is the period tolerance. eg: 0.2 means +-20%. It must be less than 0.33. A value of 0 means it is disabled.
+     * @param maxMissing is the maximum number of consecutive missing pulses that are corrected. 1 ... 4.
+     * @note - It is used with EdgeMode::RISING and EdgeMode::FALLING on the GPIO EXTI path.
+     * @note - A speed up of more than the tolerance in one period delays the measurement by one edge.
+     * @return true if successful.
+     */
+    bool setPulseClassifier(float tolerance, uint8_t maxMissing = 2);
+
+    /// @brief Return the number of missing pulses corrected by the pulse classifier since init().
+    uint32_t getMissingPulseCount(void) {return _classifier.missing;};
+
+    /// @brief Return the number of extra pulses merged by the pulse classifier since init().
+    uint32_t getExtraPulseCount(void) {return _classifier.extra;};
+
+    /**
+     * @brief Set the pulses per revolution of a uniform wheel. eg: 4 marks on the shaft. Default value: 1.  
+     * The RPM values, the revolution total and the adaptive filter use it.
+     * @note - The missing-tooth decoder value is used while the decoder is enabled.
+     * @note - If the angle estimator is enabled, its marks are set to this value.
+     * @return true if successful. false if pulses is 0.
+     */
+    bool setPulsesPerRevolution(uint16_t pulses);
+
+    /**
+     * @brief Set the missing-tooth decoder for trigger wheels with a gap. eg: 36-1 or 60-2.  
+     * The gap is recognised from the period ratios. The decoder locks when two revolutions in a row have the same pattern 
+     * and infers the pulses per revolution automatically. The RPM values are then calculated per revolution at every tooth.
+     * @param enable is true to enable the decoder.
+     * @note - It runs on the ring of edge timestamps in O(1) per edge. It is used with EdgeMode::RISING and EdgeMode::FALLING 
+     * on the GPIO EXTI path. The pulse classifier is not used while it is enabled.
+     * @note - If the angle estimator is enabled, it is set to the detected teeth with the gap as index. It does not count 
+     * edges while the decoder is not locked, and it restarts at 0 revolutions when the detected pulses per revolution change. 
+     * @note - The RPM values are 0 while the decoder is not locked.
+     * @return true if successful.
+     */
+    bool setToothDecoder(bool enable);
+
+    /**
+     * @brief Set the index callback function. It is called in the edge interrupt context at the first tooth after the gap.
+     * @note - A value of nullptr means it is disabled.
+     */
+    void setIndexCallback(IndexCallbackPtr callback);
+
+    /**
+     * @brief Get the missing-tooth decoder state.
+     * @return true if successful. false if the decoder is disabled.
+     */
+    bool getToothState(ToothStructure &data);
+
+    /**
+     * @brief Enable the period jitter histogram for sensor health. The bins count |period - predicted period| of every edge 
+     * in log2 bins. The predicted period is the last period. A growing spread shows degrading optics before they cause trips.
+     * @param enable is true to enable it. The bins are cleared.
+     * @note - The edge ring is drained in update(), so the edge interrupt has no extra cost. It is used with EdgeMode::RISING and 
+     * EdgeMode::FALLING on the GPIO EXTI path. At least one update() per TACHOMETER_OPTICAL_EDGE_RING_SIZE - 2 edges is needed to count all edges.
+     * @note - With setToothDecoder(true) the gap period and the period after it are not counted. Without the decoder a gap 
+     * adds two large values per revolution: the gap and the first tooth after it.
+     */
+    void setJitterHistogram(bool enable);
+
+    /**
+     * @brief Copy the period jitter histogram.
+     * @param bins is an array of TachometerOptical_Core::_JITTER_BINS values. Bin 0 is 0 us and bin n is 2^(n-1) to 2^n - 1 us.
+     * @return true if successful. false if it is disabled.
+     */
+    bool getJitterHistogram(uint32_t *bins);
+
+    /**
+     * @brief Set the uniform-rate speed resampler for downstream DSP. The speed of every edge (at the middle of its period) 
+     * is interpolated to a fixed sample clock and written in blocks. The block callback is called for every full block.
+     * @param rate is the sample rate. [Hz]
+     * @param mode is the interpolation. Interpolation::LINEAR or Interpolation::CUBIC (Catmull-Rom).
+     * @param buffer is the block buffer of 2 * blockSize values. The callback gets one half while the other half is filled.
+     * A value of nullptr means the resampler is disabled.
+     * @param blockSize is the number of samples of a block.
+     * @param callback is the block callback function. It is called in the update() context.
+     * @note - The edge ring is drained in update(), so the edge interrupt has no extra cost. It is used with EdgeMode::RISING and 
+     * EdgeMode::FALLING on the GPIO EXTI path. At least one update() per TACHOMETER_OPTICAL_EDGE_RING_SIZE - 1 edges is needed to use all edges.
+     * @note - After a stall or an edge timeout the stream restarts. The partial block is given to the callback first.
+     * @note - The periods are corrected like the RPM values: setPulseClassifier() corrections are used, and with setToothDecoder() 
+     * the gap is split into missing + 1 tooth periods. The stream restarts while the decoder is not locked.
+     * @return true if successful.
+     */
+    bool setResampler(float rate, TachometerOptical_Core::Interpolation mode, float *buffer, uint16_t blockSize, BlockCallbackPtr callback);
+
+    /**
+     * @brief Set the order tracking. An external signal (eg: an accelerometer) sampled by ADC DMA is resampled at fixed shaft angles, 
+     * samplesPerRevolution samples per revolution, for order FFTs.  
+     * The sample instants are calculated from the edge timestamps with constant speed between marks. The ADC sample times are 
+     * found from the DMA write position and the sample rate, and the signal is linearly interpolated between ADC samples.
+     * @param config is the configuration. A value of nullptr for config.adcBuffer means it is disabled.
+     * @note - The edge ring is drained in update(). Call update() at least once per TACHOMETER_OPTICAL_EDGE_RING_SIZE - 1 edges 
+     * and once per ADC buffer time. The ADC buffer must hold the samples of one update interval and one edge period more.
+     * @note - With the missing-tooth decoder the marks are the detected teeth and the gap is interpolated over its missing teeth.
+     * @note - It is used with EdgeMode::RISING and EdgeMode::FALLING on the GPIO EXTI path.
+     * @return true if successful.
+     */
+    bool setOrderTracking(const OrderConfigStructure &config);
+
+    /**
+     * @brief Return the number of order tracking samples that were lost because the ADC buffer was overwritten.
+     */
+    uint32_t getOrderOverrunCount(void) {return _order.overruns;};
+
+    /**
+     * @brief Set the raw edge capture buffer for post-mortem analysis. Every edge period is stored in the edge interrupt as
+     * the zig-zag varint of its change from the previous period, so near constant speed takes 1 byte per edge 
+     * instead of 4 bytes for a raw timestamp. When the buffer is full the oldest edges are dropped.
+     * @param buffer is the capture buffer. A value of nullptr means the capture is disabled.
+     * @param size is the buffer size. [bytes] It must be a power of 2 and at least 16.
+     * @note - The capture is running after this call. Freeze it with freezeCapture() before reading it.
+     * @return true if successful.
+     */
+    bool setCapture(uint8_t *buffer, uint32_t size);
+
+    /**
+     * @brief Freeze or restart the capture. Edges are not stored while it is frozen. eg: freeze it at a trip.
+     */
+    void freezeCapture(bool freeze) {_captureFrozen = freeze;};
+
+    /**
+     * @brief Return the number of edges in the capture buffer.
+     */
+    uint32_t getCaptureCount(void) {return _capture.count;};
+
+    /**
+     * @brief Start an iterator at the oldest edge of the capture.
+     * @note - Step it with captureNext(). eg: while(tacho.captureNext(cursor)) { cursor.timestamp, cursor.period }
+     * @return true if successful. false if the capture is disabled or it is not frozen.
+     */
+    bool captureBegin(TachometerOptical_Core::CaptureCursorStructure &cursor);
+
+    /**
+     * @brief Decode the next edge of the capture. The edge time and period are in cursor.timestamp and cursor.period. [us]
+     * @return true if successful. false if there is no more edge.
+     */
+    bool captureNext(TachometerOptical_Core::CaptureCursorStructure &cursor);
+
+    /**
+     * @brief Set the triggered pre/post capture of edge timestamps ("logic-analyzer mode").  
+     * The last edges are kept in the active slot. When a trigger condition fires, postEdges more edges are recorded and the slot is frozen 
+     * with preEdges edges before the trigger. The next slot is then active. When all slots are captured the recording stops.
+     * @param buffer is the slot buffer. Its size must be slots * (preEdges + postEdges) values. A value of nullptr means it is disabled.
+     * @param slots is the number of slots. 1 to TachometerOptical_Core::_TRIGGER_SLOTS_MAX.
+     * @note - Until a trigger fires it costs one ring write in the edge interrupt. The conditions are checked in update().
+     * @note - Call it again to clear the slots and restart the recording.
+     * @return true if successful.
+     */
+    bool setTriggerCapture(uint32_t *buffer, uint16_t preEdges, uint16_t postEdges, uint8_t slots = 1);
+
+    /**
+     * @brief Set the trigger conditions of the triggered capture. A value of 0 means the condition is disabled.
+     * @param aboveRPM fires when the raw RPM value is above it.
+     * @param belowRPM fires when the raw RPM value is below it while the channel is running.
+     * @param slew fires when the raw RPM value changes faster than it between two updates. [RPM/s]
+     * @param stall is true to fire when the channel stalls or its edges time out.
+     * @note - A condition fires once when it becomes true. It can fire again after it was false at one update().
+     * @return true if successful.
+     */
+    bool setTriggerConditions(float aboveRPM, float belowRPM, float slew, bool stall);
+
+    /**
+     * @brief External trigger of the triggered capture. It can be called in an interrupt.
+     * @return true if successful. false if the capture is disabled, a trigger is pending or all slots are captured.
+     */
+    bool trigger(void);
+
+    /**
+     * @brief Return the number of captured slots.
+     */
+    uint8_t getTriggerSlotCount(void) {return _trigger.active;};
+
+    /**
+     * @brief Get the trigger event, time and edge counts of a captured slot.
+     * @return true if successful. false if the slot is not captured.
+     */
+    bool getTriggerSlot(uint8_t slot, TachometerOptical_Core::TriggerSlotStructure &data);
+
+    /**
+     * @brief Copy the edge timestamps of a captured slot in time order.
+     * @param edges is the output array. [us]
+     * @param size is the size of the output array.
+     * @param preEdges is the number of copied edges before the trigger.
+     * @return The number of copied edges. 0 if the slot is not captured.
+     */
+    uint16_t readTriggerSlot(uint8_t slot, uint32_t *edges, uint16_t size, uint16_t &preEdges);
+
+    /**
+     * @brief Set the tiered RPM history. The filtered RPM value of every update() is the input of tier 0, and each tier 
+     * is built from the tier below with min/mean/max aggregation. eg: with 1 kHz update frequency and factors {1, 100, 100} 
+     * the tiers have 1 ms, 100 ms and 10 s points.
+     * @param buffer is the point buffer. Its size must be tiers * points. A value of nullptr means it is disabled.
+     * @param points is the number of points of each tier.
+     * @param tiers is the number of tiers. 1 to TachometerOptical_Core::_HISTORY_TIERS_MAX.
+     * @param factors is the array of tiers aggregation factors. Each value must be at least 1.
+     * @note - The memory is only the user buffer and it is fixed. The update frequency should be set, so the points are periodic.
+     * @return true if successful.
+     */
+    bool setHistory(TachometerOptical_Core::HistoryPointStructure *buffer, uint16_t points, uint8_t tiers, const uint16_t *factors);
+
+    /**
+     * @brief Copy the last points of a history tier, from the oldest to the last.
+     * @param points is the output array.
+     * @param count is the maximum number of points.
+     * @return The number of copied points. It costs O(points returned).
+     */
+    uint16_t getHistory(uint8_t tier, TachometerOptical_Core::HistoryPointStructure *points, uint16_t count);
+
+    /**
+     * @brief Copy the RPM trend of a time span from the finest history tier that covers it with count points.
+     * @param span is the time span. [s]
+     * @param points is the output array, from the oldest to the last point.
+     * @param count is the maximum number of points.
+     * @param interval is the time between the returned points. [s]
+     * @return The number of copied points. 0 if the history is disabled or the update frequency is 0.
+     */
+    uint16_t getTrend(float span, TachometerOptical_Core::HistoryPointStructure *points, uint16_t count, float &interval);
+
+    /**
+     * @brief Set the time-at-speed histogram (load spectrum). Every valid edge adds its time from the last edge [us] 
+     * to the bin of the measured speed.
+     * @param RPMEdges is the array of bin edges in ascending order. [RPM] Bin 0 is below RPMEdges[0] and bin edges is above RPMEdges[edges - 1].
+     * @param edges is the number of bin edges.
+     * @param periodEdges is an array of edges values. The bin edges are converted to periods in it, so the interrupt does integer compares.
+     * @param bins is the array of edges + 1 bins. It is cleared here. It can be saved and restored by the user for lifetime totals.
+     * @note - A value of nullptr for bins means it is disabled.
+     * @note - The bin lookup is a binary search in the edge interrupt. O(log(edges))
+     * @return true if successful.
+     */
+    bool setHistogram(const float *RPMEdges, uint16_t edges, uint32_t *periodEdges, uint64_t *bins);
+
+    /**
+     * @brief Return the time in a histogram bin. [us] eg: hours = value / 3.6e9
+     */
+    uint64_t getHistogramBin(uint16_t bin);
+
+    /**
+     * @brief Set the shaft angle estimator. The angle is counted by mark edges and interpolated between them.
+     * @param marks is the number of marks on the wheel. A value of 0 means it is disabled.
+     * @param useIndex is true if an index pulse marks the start of a revolution. Call indexPulse() for it.
+     * @return true if successful.
+     */
+    bool setAngleEstimator(uint16_t marks, bool useIndex = false);
+
+    /**
+     * @brief Index pulse input of the angle estimator. Call it in the interrupt of the index sensor.
+     * @note - The next mark edge after it is mark 0. Place the index sensor between the last mark and mark 0.
+     */
+    void indexPulse(void) {_indexPending = true;};
+
+    /**
+     * @brief Get the shaft angle estimate at a time.
+     * @param timestamp is the requested time in the TimerControl micros() time base. [us]
+     * @note - It is lock-free with one division, so it can be called from a high rate control interrupt.
+     * @return true if successful. false if the angle estimator is disabled.
+     */
+    bool getAngle(uint32_t timestamp, AngleStructure &data);
+
+    /**
+     * @brief Get the shaft angle estimate at the current time.
+     * @return true if successful. false if the angle estimator is disabled.
+     */
+    bool getAngle(AngleStructure &data);
+
+    /**
+     * @brief Set the hardware stall watchdog. 
+     * On every edge a timer output-compare is armed at lastEdge + timeout. If it fires, the channel is marked stalled 
+     * and the RPM values are zeroed in the interrupt, without any update() call.
+     * @param htim is the watchdog timer handle. A value of nullptr means the watchdog is disabled.
+     * @param channel is the timer channel. It can be TIM_CHANNEL_1, TIM_CHANNEL_2, TIM_CHANNEL_3 or TIM_CHANNEL_4.
+     * @param timeout is the stall timeout in timer counter ticks. It must be less than the timer auto-reload value.
+     * @note - The timer must be configured and started outside of the object. Free running with auto-reload value 0xFFFF or 0xFFFFFFFF.
+     * @note - The timer channel must be configured in output compare timing mode (no output) and the timer interrupt must be enabled in NVIC.
+     * @note - Call STALL_Callback in HAL_TIM_OC_DelayElapsedCallback() for this timer and channel.
+     * @return true if successful.
+     */
+    bool setStallWatchdog(TIM_HandleTypeDef* htim, uint32_t channel, uint32_t timeout);
+
+    /**
+     * @brief Set the stall callback function. It is called in the watchdog timer interrupt context.
+     * @note - A value of nullptr means it is disabled.
+     */
+    void setStallCallback(StallCallbackPtr callback);
+
+    /**
+     * @brief Get a coherent snapshot of the last results published by update().
+     * @note - It is lock-free and can be called from any context. eg: other interrupts or RTOS tasks.
+     * @note - RPM values are zero in the snapshot while the channel is stalled.
+     * @return true if successful. false if nothing is published yet.
+     */
+    bool getMeasurement(MeasurementStructure &data);
+
+    /**
+     * @brief Return the generation number of the last published measurement. 
+     * Compare it with a previous value to check whether a new measurement is available.
+     */
+    uint32_t getMeasurementSequence(void) {return _measurement.getSequence();};
+
+    /**
+     * @brief Suspend the calling task until update() publishes a new measurement for the channel.
+     * @param timeout is the maximum waiting time. [ms]
+     * @note - Backend: FreeRTOS task notification, CMSIS-RTOS2 event flags or bare-metal WFE. See mcu_select.h.
+     * @note - Only one task can wait on each event of a channel at the same time.
+     * @note - The FreeRTOS backend uses the task notification at index 0 of the waiting task.
+     * @return true if a new measurement is available. false if timeout.
+     */
+    bool waitForMeasurement(uint32_t timeout);
+
+    /**
+     * @brief Suspend the calling task until the next revolution pulse of the channel.
+     * @param timeout is the maximum waiting time. [ms]
+     * @note - The backend notes of waitForMeasurement() are also valid for this method.
+     * @note - With an RTOS backend the pulse is notified from the edge interrupt, so parameters.INTERRUPT_PRIORITY must be an RTOS API 
+     * interrupt priority. The default priority 0 is not allowed. For the PWM_TIMER path the same is valid for the timer interrupt.
+     * @return true if a new pulse arrived. false if timeout.
+     */
+    bool waitForRevolution(uint32_t timeout);
+
+    /// @brief Return the number of pulses received since init().
+    uint32_t getPulseCount(void) {return _edgeCount;};
+
+    /**
+     * @brief Return the 64-bit pulse total (odometer). It is counted in the edge interrupt, so it has no integration drift. 
+     * Corrected missing pulses and missing teeth are counted.
+     * @note - The value is read tear-free.
+     */
+    uint64_t getTotalPulses(void);
+
+    /**
+     * @brief Return the 64-bit revolution total. It is the pulse total divided by the pulses per revolution 
+     * (setPulsesPerRevolution() or the missing-tooth decoder value).
+     */
+    uint64_t getTotalRevolutions(void);
+
+    /**
+     * @brief Set the pulse total. eg: restore it from a flash or EEPROM record.
+     */
+    void setTotalPulses(uint64_t pulses);
+
+    /**
+     * @brief Set the backup memory of the pulse total and restore the total from it.  
+     * The total is saved in update() when it changed, so it survives resets. eg: 8 words of backup SRAM or RTC backup registers of STM32F4/H7.
+     * @param backup is an array of 8 words: two records of low word, high word, sequence number and check word. A value of nullptr means it is disabled.
+     * @param interval is the minimum time between two saves. [ms] It is limited to 1 hour. The pulses after the last save are lost at a reset.
+     * @note - The records are written in turn, so a reset or brown-out during a save only breaks the newer record. 
+     * The newest valid record is restored.
+     * @note - The backup domain write access must be enabled outside of the object. eg: HAL_PWR_EnableBkUpAccess().
+     * @return true if a saved total is restored. false if the backup is disabled or no record is valid. eg: after a battery loss.
+     */
+    bool setTotalizerBackup(volatile uint32_t *backup, uint32_t interval = 1000);
+
+    /// @brief Return true if the stall watchdog fired and no pulse arrived after it.
+    bool getStallState(void) {return _stalled;};
+
+    /// @brief Return true if the channel is in the overspeed state.
+    bool getOverspeedState(void) {return _overspeed.state;};
+
+    /// @brief Return true if the channel is in the underspeed state.
+    bool getUnderspeedState(void) {return _underspeed.state;};
+
   private:
 
+    /**
+      @struct ThresholdStructure
+      @brief Threshold state that is checked in the edge interrupt.
+    */ 
+    struct ThresholdStructure
+    {
+      /// @brief Period limit that sets the state. [us]
+      uint32_t tripPeriod;
+
+      /// @brief Period limit that clears the state. [us]
+      uint32_t releasePeriod;
+
+      /// @brief Number of consecutive pulses needed to change the state.
+      uint8_t debounce;
+
+      /// @brief Number of consecutive pulses that crossed the current limit.
+      uint8_t counter;
+
+      /// @brief Threshold state. true means tripped.
+      volatile bool state;
+    };
+
+    /// @brief Overspeed threshold. It trips when the period is less than tripPeriod.
+    ThresholdStructure _overspeed;
+
+    /// @brief Underspeed threshold. It trips when the period is more than tripPeriod.
+    ThresholdStructure _underspeed;
+
+    /// @brief Threshold callback function pointer.
+    ThresholdCallbackPtr _thresholdCallback;
+
+    /**
+      @struct WatchdogStructure
+      @brief Hardware stall watchdog parameters.
+    */ 
+    struct WatchdogStructure
+    {
+      /// @brief Watchdog timer handle. A value of nullptr means the watchdog is disabled.
+      TIM_HandleTypeDef* htim;
+
+      /// @brief Watchdog timer channel.
+      uint32_t channel;
+
+      /// @brief Compare interrupt/flag mask for the timer channel. eg: TIM_IT_CC1.
+      uint32_t interrupt;
+
+      /// @brief Stall timeout. [timer ticks]
+      uint32_t timeout;
+
+      /// @brief Timer counter mask. It is the timer auto-reload value.
+      uint32_t mask;
+
+      /// @brief Timer counter value at the last edge. [timer ticks]
+      volatile uint32_t lastEdgeTick;
+    }_watchdog;
+
+    /// @brief Stall state. true means the stall watchdog fired and no pulse arrived after it.
+    volatile bool _stalled;
+
+    /// @brief Stall callback function pointer.
+    StallCallbackPtr _stallCallback;
+
+    /// @brief Double buffer for measurement publication.
+    TachometerOptical_Namespace::DoubleBuffer<MeasurementStructure> _measurement;
+
+    /// @brief Edge state of the channel. It is only written in the edge interrupt.
+    TachometerOptical_Core::EdgeStateStructure _edgeState;
+
+    /// @brief Double buffer for edge state publication to getSnapshot().
+    TachometerOptical_Namespace::DoubleBuffer<TachometerOptical_Core::EdgeStateStructure> _edgeSnapshot;
+
+    /**
+      @struct AngleEstimatorStructure
+      @brief Angle estimator parameters and state.
+    */ 
+    struct AngleEstimatorStructure
+    {
+      /// @brief Number of marks on the wheel. A value of 0 means it is disabled.
+      uint16_t marks;
+
+      /// @brief Precomputed: 1 / marks. [revolution]
+      float markStep;
+
+      /// @brief true if revolutions are counted by the index pulse.
+      bool useIndex;
+
+      /// @brief Angle state. It is only written in the edge interrupt.
+      TachometerOptical_Core::AngleStateStructure state;
+    }_angle;
+
+    /// @brief Double buffer for angle state publication to getAngle().
+    TachometerOptical_Namespace::DoubleBuffer<TachometerOptical_Core::AngleStateStructure> _angleSnapshot;
+
+    /// @brief Index pulse flag. It is set by indexPulse() and cleared at the next mark edge.
+    volatile bool _indexPending;
+
+    /// @brief Times of the last rising (cell 1) and falling (cell 0) edges in EdgeMode::BOTH. [us]
+    uint32_t _edgeTime[2];
+
+    /// @brief Bit n is set if an edge of level n is received after the warm-up start. Used in EdgeMode::BOTH.
+    uint8_t _edgeSeen;
+
+    /// @brief Last mark (high level) width. [us]
+    volatile uint32_t _width;
+
+    /// @brief Period that contains the last mark width. [us] A value of 0 means no width is measured.
+    volatile uint32_t _widthPeriod;
+
+    /// @brief Missing and extra pulse classifier. It is only written in the edge interrupt after setPulseClassifier().
+    TachometerOptical_Core::PulseClassifierStructure _classifier;
+
+    /// @brief Ring of raw edge timestamps, also edges that are not used by the classifier. [us]
+    uint32_t _edgeRing[TACHOMETER_OPTICAL_EDGE_RING_SIZE];
+
+    /// @brief Number of raw edges since init(). The last edge is in _edgeRing[(_rawEdgeCount - 1) % TACHOMETER_OPTICAL_EDGE_RING_SIZE].
+    volatile uint32_t _rawEdgeCount;
+
+    /// @brief true if the period jitter histogram is enabled.
+    bool _jitterEnabled;
+
+    /// @brief Value of _rawEdgeCount at the last drain of the edge ring to the jitter histogram.
+    uint32_t _jitterEdgeCount;
+
+    /// @brief Period jitter histogram bins.
+    uint32_t _jitter[TachometerOptical_Core::_JITTER_BINS];
+
+    /**
+      @struct BlockStructure
+      @brief Ping-pong block output of the resampler and the order tracking.
+    */ 
+    struct BlockStructure
+    {
+      /// @brief Block buffer of 2 * size values. nullptr if the output is disabled.
+      float *buffer;
+
+      /// @brief Number of samples of a block.
+      uint16_t size;
+
+      /// @brief Number of samples in the filling block.
+      uint16_t fill;
+
+      /// @brief Filling half of the block buffer. 0 or 1.
+      uint8_t half;
+
+      /// @brief Time of the first sample of the filling block. [us]
+      uint32_t timestamp;
+
+      /// @brief Block callback function pointer.
+      BlockCallbackPtr callback;
+    };
+
+    /**
+      @struct ResampleStructure
+      @brief Uniform-rate speed resampler state.
+    */ 
+    struct ResampleStructure
+    {
+      /// @brief Resampler of the speed points.
+      TachometerOptical_Core::ResamplerStructure resampler;
+
+      /// @brief Block output. The resampler is disabled if its buffer is nullptr.
+      BlockStructure block;
+
+      /// @brief Value of _rawEdgeCount at the last drain of the edge ring.
+      uint32_t edgeCount;
+
+      /// @brief Pulse classifier of the drained edges. It has the configuration of the edge interrupt classifier.
+      TachometerOptical_Core::PulseClassifierStructure classifier;
+
+      /// @brief Start time of the next period. It is older than the last edge after a short fragment. [us]
+      uint32_t start;
+
+      /// @brief Last pulse period. A value of 0 means unknown. It splits the missing-tooth gap. [us]
+      uint32_t period;
+    };
+
+    /// @brief Uniform-rate speed resampler. It is used in update().
+    ResampleStructure _resample;
+
+    /**
+      @struct OrderTrackingStructure
+      @brief Order tracking state.
+    */ 
+    struct OrderTrackingStructure
+    {
+      /// @brief Angle grid of the samples.
+      TachometerOptical_Core::OrderStructure order;
+
+      /// @brief ADC buffer. nullptr if the order tracking is disabled.
+      const volatile uint16_t *adcBuffer;
+
+      /// @brief Number of samples of the ADC buffer.
+      uint32_t adcSize;
+
+      /// @brief DMA handle of the ADC buffer.
+      DMA_HandleTypeDef *hdma;
+
+      /// @brief ADC sample period. [us]
+      float adcPeriod;
+
+
+      /// @brief Block output.
+      BlockStructure block;
+
+      /// @brief Value of _rawEdgeCount at the last processed edge.
+      uint32_t edgeCount;
+
+      /// @brief Last processed period. A value of 0 means the stream restarts.
+      uint32_t period;
+
+      /// @brief Number of samples lost by ADC buffer overwrite.
+      uint32_t overruns;
+    };
+
+    /// @brief Order tracking. It is used in update().
+    OrderTrackingStructure _order;
+
+    /// @brief true if the missing-tooth decoder is enabled.
+    bool _toothDecoderEnabled;
+
+    /// @brief Missing-tooth decoder state. It is only written in the edge interrupt after setToothDecoder().
+    TachometerOptical_Core::ToothDecoderStructure _toothDecoder;
+
+    /// @brief Index callback function pointer.
+    IndexCallbackPtr _indexCallback;
+
+    /// @brief Pulses per revolution. Periods are multiplied by it for the RPM values. It is set by the missing-tooth decoder.
+    uint16_t _pulsesPerRevolution;
+
+    /// @brief Pulses per revolution of setPulsesPerRevolution(). It is used when the missing-tooth decoder is disabled.
+    uint16_t _userPulsesPerRevolution;
+
+    /// @brief Compressed raw edge capture. It is only written in the edge interrupt while it is not frozen.
+    TachometerOptical_Core::CaptureStructure _capture;
+
+    /// @brief true if the capture is frozen.
+    volatile bool _captureFrozen;
+
+    /**
+      @struct TriggerConditionStructure
+      @brief Trigger conditions of the triggered capture. A value of 0 means the condition is disabled.
+    */ 
+    struct TriggerConditionStructure
+    {
+      /// @brief Raw RPM limits. [RPM]
+      float aboveRPM;
+      float belowRPM;
+
+      /// @brief Raw RPM change rate limit. [RPM/us]
+      float slew;
+
+      /// @brief true if stalls fire the trigger.
+      bool stall;
+    };
+
+    /// @brief Triggered capture. Its active slot is written in the edge interrupt.
+    TachometerOptical_Core::TriggerCaptureStructure _trigger;
+
+    /// @brief Trigger conditions.
+    TriggerConditionStructure _triggerCondition;
+
+    /// @brief Raw RPM value of the last trigger check.
+    float _triggerRawRPM;
+
+    /// @brief Trigger conditions that were true at the last trigger check. Bit n is TriggerEvent n.
+    uint8_t _triggerActive;
+
+    /// @brief Tiered RPM history. It is written in update().
+    TachometerOptical_Core::HistoryStructure _history;
+
+    /// @brief Time-at-speed histogram. It is written in the edge interrupt.
+    TachometerOptical_Core::HistogramStructure _histogram;
+
+    /// @brief Number of pulses received since init(). It is incremented in the edge interrupt.
+    volatile uint32_t _edgeCount;
+
+    /// @brief High word of the pulse total. It is incremented when _edgeCount wraps.
+    volatile uint32_t _edgeCountHigh;
+
+    /// @brief Pulse total at init() or setTotalPulses(). The pulse total is _totalOffset + (_edgeCountHigh:_edgeCount).
+    uint64_t _totalOffset;
+
+    /// @brief Backup memory of the pulse total. 2 records of 4 words: low, high, sequence and check.
+    volatile uint32_t *_totalBackup;
+
+    /// @brief Sequence number of the last saved record. The record index is its bit 0.
+    uint32_t _totalSequence;
+
+    /// @brief Last saved pulse total.
+    uint64_t _totalSaved;
+
+    /// @brief Minimum time between two saves and the time of the last save. [us]
+    uint32_t _totalInterval;
+    uint32_t _totalSaveTime;
+
+    /// @brief Value of _edgeCount at the last update() of the channel.
+    uint32_t _updateEdgeCount;
+
+    /// @brief Speed-proportional low-pass filter. It is disabled if its revolutions value is 0.
+    TachometerOptical_Core::AdaptiveFilterStructure _adaptiveFilter;
+
+    /// @brief Warm-up state. A valid period needs two edges after init() or a stall.
+    volatile TachometerOptical_Core::WarmupState _warmup;
+
+    /**
+     * @enum WaitEvent
+     * @brief Events that a task can wait for.
+     */
+    enum WaitEvent : uint8_t
+    {
+      WAIT_MEASUREMENT = 0,         ///< New measurement published by update().
+      WAIT_REVOLUTION = 1           ///< New pulse in the edge interrupt.
+    };
+
+    #if defined(TACHOMETER_OPTICAL_FREERTOS)
+    /// @brief Tasks that wait for each event. A value of nullptr means no task is waiting.
+    volatile TaskHandle_t _waitTask[2];
+    #elif defined(TACHOMETER_OPTICAL_CMSIS_RTOS2)
+    /// @brief Event flags object for waiting tasks. Bit n is set for WaitEvent n.
+    osEventFlagsId_t _waitFlags;
+    #endif
+
     /**
      * @brief TimerControl pointer. 
      * @note - Set this timer carefully because the object calculate RPM by this timer.
@@ -178,32 +1337,22 @@ class TachometerOptical
      */
     static TimerControl* _TIMER;
 
-    /**
-     * @brief Minimum RPM value accepted in the update method. If the RPM is below this minimum, it returns a zero value.
-     * @note - This parameter is static and applies globally to all TachometerOptical objects.
-    */
-    static uint16_t _MIN;
+    /// @brief Edge sink function and its context. A value of nullptr means it is disabled. eg: TachometerTelemetry.
+    static EdgeSinkPtr _edgeSink;
+    static void* _edgeSinkContext;
 
-    /**
-     * @brief Maximum RPM value accepted in the update method. If the RPM is above this maximum, it returns the last updated value.
-     * @note - A value of 0 means it is disabled.
-     * @note - This parameter is static and applies globally to all TachometerOptical objects.
-    */
-    static uint16_t _MAX;
-
-    /**
-     * @brief Low pass filter frequency(Cutoff filter frequency). [Hz].  
-     * @note - A value of 0 means it is disabled.
-     * @note - This parameter is static and applies globally to all TachometerOptical objects.
-    */ 
-    static float _FILTER_FRQ;
+    /// @brief Edge sink function of a telemetry object.
+    template <class Telemetry>
+    static void _telemetrySink(void *context, uint8_t channel, uint32_t timestamp)
+    {
+      static_cast<Telemetry*>(context)->push(channel, timestamp);
+    }
 
     /**
-     * @brief Update frequency. This value ensures that RPM filtered values are updated at a certain frequency. 
-     * @note - A value of 0 means it is disabled.
+     * @brief RPM update and filter configuration. MIN, MAX, FILTER_FRQ and UPDATE_FRQ.
      * @note - This parameter is static and applies globally to all TachometerOptical objects.
-    */ 
-    static float _UPDATE_FRQ;
+    */
+    static TachometerOptical_Core::FilterConfigStructure _config;
 
     /**
      * @brief Static array to store instances per channel.  
@@ -223,12 +1372,6 @@ class TachometerOptical
      */
     volatile uint32_t _period;				
     
-    /**
-      @brief Gain used in low-pass filter calculations.  
-      @note _alpha = 1.0 / (1.0 + _2PI * FILTER_FRQ / UPDATE_FRQ)
-    */ 
-    static float _alpha;
-    
     /// @brief Time at the update() method. [us].
     static volatile uint32_t _T;
 
@@ -238,6 +1381,132 @@ class TachometerOptical
     */
     bool _checkParameters(void);
 
+    /**
+     * @brief Update and calculate filtered RPM value for the channel.
+     * @param t is the update time. [us]
+     * @param dt is the time from the last update. [us]
+     * @param alpha is the low-pass filter gain for this update.
+     */
+    void _updateChannel(uint32_t t, uint32_t dt, float alpha);
+
+    /**
+     * @brief Publish the channel results in the measurement double buffer.
+     * @param period is the period time value used for the measurement. [us]
+     * @param timestamp is the time of the last edge used for the measurement. [us]
+     * @param width is the last mark width. [us]
+     */
+    void _publish(uint32_t period, uint32_t timestamp, uint32_t width);
+
+    /// @brief Return the counter of an event. It changes when the event happens.
+    uint32_t _eventCounter(WaitEvent event);
+
+    /**
+     * @brief Wait until an event counter differs from its value at the call time.
+     * @param event is the WaitEvent.
+     * @param timeout is the maximum waiting time. [ms]
+     * @return true if the counter changed. false if timeout.
+     */
+    bool _wait(WaitEvent event, uint32_t timeout);
+
+    /**
+     * @brief Wake the task that waits for an event.
+     * @note - It can be called from task or interrupt context.
+     */
+    void _notify(WaitEvent event);
+
+    /**
+     * @brief Edge interrupt handler. Calculate period for the edge mode.
+     * @param tNow is the edge time. [us]
+     */
+    void _edgeHandler(uint32_t tNow);
+
+    /**
+     * @brief PWM input capture interrupt handler. Read period and mark width from the timer.
+     */
+    void _pwmHandler(void);
+
+    /**
+     * @brief Write the raw edge time to the edge sink, the compressed capture and the triggered capture.
+     * @param tNow is the edge time. [us]
+     */
+    void _rawEdge(uint32_t tNow);
+
+    /**
+     * @brief Drain the new edges of the edge ring to the period jitter histogram.
+     */
+    void _drainJitter(void);
+
+    /**
+     * @brief Drain the new edges of the edge ring to the resampler and write the samples in the block buffer.
+     */
+    void _drainResampler(void);
+
+    /**
+     * @brief Drain the new edges of the edge ring to the order tracking and write the angle domain samples in the block buffer.
+     */
+    void _drainOrder(void);
+
+    /**
+     * @brief Copy the new edges of the edge ring.
+     * @param first is the value of _rawEdgeCount at the last drain. It is moved forward if old edges are overwritten.
+     * @param edges is an array of TACHOMETER_OPTICAL_EDGE_RING_SIZE values. edges[0] is the edge before the new edges.
+     * @return The number of copied edges. It is 0 if there is no new edge.
+     */
+    uint32_t _copyEdges(uint32_t &first, uint32_t *edges);
+
+    /**
+     * @brief Write a sample to a block output. Full blocks are given to the block callback.
+     * @param timestamp is the sample time. [us]
+     */
+    void _writeBlock(BlockStructure &block, uint32_t timestamp, float sample);
+
+    /**
+     * @brief Give the filling block to the block callback and switch the block buffer halves.
+     */
+    void _sendBlock(BlockStructure &block);
+
+    /**
+     * @brief Check the trigger conditions of the triggered capture in update().
+     * @param lastWarmup is the warm-up state before the update.
+     * @param warmup is the warm-up state after the update.
+     */
+    void _checkTrigger(uint32_t t, uint32_t dt, float rawRPM, TachometerOptical_Core::WarmupState lastWarmup, TachometerOptical_Core::WarmupState warmup);
+
+    /**
+     * @brief Common edge processing. Warm-up, stall watchdog, thresholds and publications.
+     * @param tNow is the edge time. [us]
+     * @param period is the period that ends at this edge. [us]
+     * @param complete is false if the period is not complete. eg: EdgeMode::BOTH before an edge of the same level.
+     * @param pulses is the number of pulses that end at this edge. It is more than 1 if the classifier corrected missing pulses.  
+     * A value of 0 means the edge only updates the speed. eg: falling edges of EdgeMode::BOTH.
+     * @param toothIndex is true if this edge is the index from the missing-tooth decoder.
+     */
+    void _recordEdge(uint32_t tNow, uint32_t period, bool complete, uint8_t pulses = 1, bool toothIndex = false);
+
+    /**
+     * @brief Remove pulses from the pulse total and the angle estimator. It is called in the edge interrupt when the classifier 
+     * undoes a missing pulse correction.
+     */
+    void _undoPulses(uint8_t pulses);
+
+    /**
+     * @brief Set the pulses per revolution and the values that depend on it. It is called in the edge interrupt.
+     */
+    void _setPulsesPerRevolution(uint16_t pulsesPerRevolution);
+
+    /**
+     * @brief Stall watchdog compare interrupt handler. Mark the channel stalled and zero the RPM values.
+     */
+    void _stallHandler(void);
+
+    /**
+     * @brief Update a threshold state with a crossing result.
+     * @param threshold is the threshold structure.
+     * @param cross is true if the current pulse crossed the active limit.
+     * @param tripEvent is the event fired when the state is set.
+     */
+    void _thresholdHandler(ThresholdStructure &threshold, bool cross, ThresholdEvent tripEvent);
+
     /**
      * @brief Enable RCC GPIO PORT for certain port.
      */
@@ -254,6 +1523,24 @@ class TachometerOptical
 
     /// @brief Interrupt handler function for TachometerOptical channel 3.
     friend void TachometerOptical_Namespace::_calcInput_CH3(void);
+
+    /// @brief Stall watchdog compare interrupt handler function for TachometerOptical channel 1.
+    friend void TachometerOptical_Namespace::_stallInput_CH1(void);
+
+    /// @brief Stall watchdog compare interrupt handler function for TachometerOptical channel 2.
+    friend void TachometerOptical_Namespace::_stallInput_CH2(void);
+
+    /// @brief Stall watchdog compare interrupt handler function for TachometerOptical channel 3.
+    friend void TachometerOptical_Namespace::_stallInput_CH3(void);
+
+    /// @brief PWM input capture interrupt handler function for TachometerOptical channel 1.
+    friend void TachometerOptical_Namespace::_pwmInput_CH1(void);
+
+    /// @brief PWM input capture interrupt handler function for TachometerOptical channel 2.
+    friend void TachometerOptical_Namespace::_pwmInput_CH2(void);
+
+    /// @brief PWM input capture interrupt handler function for TachometerOptical channel 3.
+    friend void TachometerOptical_Namespace::_pwmInput_CH3(void);
     
 };
 
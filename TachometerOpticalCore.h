@@ -0,0 +1,1565 @@
+#pragma once
+
+// ##################################################################
+// Library information:
+/*
+TachometerOpticalCore - Hardware independent calculations of the TachometerOptical library.
+It has no HAL or MCU dependency, so the same code is used by the firmware and by host tools.
+For more information read README.md file.
+*/
+// ###################################################################
+// Include libraaries:
+
+#include <stdint.h>
+
+// ###################################################################################
+//  General function declarations:
+
+namespace TachometerOptical_Core
+{
+  /// @brief 2*pi
+  constexpr double _2PI = 6.2831853;
+
+  /// @brief Edge age after that the RPM is zero. [us]
+  constexpr uint32_t _EDGE_TIMEOUT = 1000000;
+
+  /// @brief Maximum accepted RPM slew rate. Faster changes are rejected as noise. [RPM/us]
+  constexpr float _MAX_SLEW = 10000.0f;
+
+  /// @brief RPM of a 1 us period for a single mark shaft. [RPM*us]
+  constexpr float _RPM_US = 60000000.0f;
+
+  /**
+    @struct FilterConfigStructure
+    @brief RPM update and filter configuration.
+    @note - Create it with makeFilterConfig(). It fills the precomputed values, also at compile time with constexpr.
+  */
+  struct FilterConfigStructure
+  {
+    /**
+     * @brief Minimum RPM value accepted in the update method. If the RPM is below this minimum, it returns a zero value.
+     */
+    uint16_t MIN;
+
+    /**
+     * @brief Maximum RPM value accepted in the update method. If the RPM is above this maximum, it returns the last updated value.
+     * @note - A value of 0 means it is disabled.
+     */
+    uint16_t MAX;
+
+    /**
+     * @brief Low pass filter frequency(Cutoff filter frequency). [Hz].
+     * @note - A value of 0 means it is disabled.
+     */
+    float FILTER_FRQ;
+
+    /**
+     * @brief Update frequency. This value ensures that RPM filtered values are updated at a certain frequency.
+     * @note - A value of 0 means it is disabled.
+     */
+    float UPDATE_FRQ;
+
+    /// @brief Precomputed: minimum time between updates. It is ceil(1e6 / UPDATE_FRQ) and 0 if disabled. [us]
+    uint32_t updateInterval;
+
+    /// @brief Precomputed: 2pi * FILTER_FRQ / 1e6. [1/us]
+    float filterK;
+
+    /// @brief Precomputed: low-pass filter gain at the nominal update interval. Used when UPDATE_FRQ is not 0.
+    float alpha;
+
+    /// @brief Precomputed: periods below this value are above MAX. 0 if MAX is disabled. [us]
+    uint32_t minPeriod;
+
+    /// @brief Precomputed: periods below this value are above MIN. [us]
+    uint32_t maxPeriod;
+
+    /// @brief Precomputed: periods above this value are below MIN. It is maxPeriod - 1 if 60e6 / MIN is not an integer. [us]
+    uint32_t zeroPeriod;
+  };
+
+  /// @brief Return ceil(value) for positive values. It can be evaluated at compile time.
+  constexpr uint32_t _ceil(double value)
+  {
+    return (uint32_t)value + ( ((double)(uint32_t)value < value) ? 1 : 0 );
+  }
+
+  /**
+   * @brief Create a filter configuration with precomputed values.
+   * @note - Use it with constexpr for build time fixed products, so nothing is calculated at run time:  
+   * static constexpr TachometerOptical_Core::FilterConfigStructure config = TachometerOptical_Core::makeFilterConfig(100, 6000, 5, 100);
+   */
+  constexpr FilterConfigStructure makeFilterConfig(uint16_t min, uint16_t max, float filterFrq, float updateFrq)
+  {
+    return FilterConfigStructure
+    {
+      min,
+      max,
+      filterFrq,
+      updateFrq,
+      (updateFrq > 0) ? _ceil(1000000.0 / updateFrq) : 0,
+      (float)(_2PI * filterFrq / 1000000.0),
+      ( (filterFrq > 0) && (updateFrq > 0) ) ? (float)(1.0 / (1.0 + _2PI * filterFrq / updateFrq)) : 0.0f,
+      (max > 0) ? _ceil(60000000.0 / max) : 0,
+      (min > 0) ? _ceil(60000000.0 / min) : UINT32_MAX,
+      (min > 0) ? (uint32_t)(60000000.0 / min) : UINT32_MAX
+    };
+  }
+
+  /// @brief Size of the adaptive filter gain table.
+  constexpr uint8_t _ADAPTIVE_TABLE_SIZE = 8;
+
+  /**
+    @struct AdaptiveFilterStructure
+    @brief Speed-proportional low-pass filter. Its cutoff frequency follows the pulse rate, so the smoothing is 
+    a fixed number of revolutions at any speed.
+    @note - Each new pulse multiplies the filter gain by beta. An update with n new pulses uses alpha = beta^n.
+  */
+  struct AdaptiveFilterStructure
+  {
+    /// @brief Filter time constant. [revolutions] A value of 0 means it is disabled.
+    float revolutions;
+
+    /// @brief Precomputed: beta^n for n = 0 ... _ADAPTIVE_TABLE_SIZE.
+    float alphaTable[_ADAPTIVE_TABLE_SIZE + 1];
+  };
+
+  /**
+   * @brief Create an adaptive filter.
+   * @param revolutions is the filter time constant. [revolutions] A value of 0 means it is disabled.
+   * @param pulsesPerRevolution is the number of pulses in one revolution.
+   */
+  inline AdaptiveFilterStructure makeAdaptiveFilter(float revolutions, uint16_t pulsesPerRevolution)
+  {
+    AdaptiveFilterStructure filter;
+
+    filter.revolutions = (revolutions > 0) ? revolutions : 0;
+
+    // Time constant of N pulses: beta = N / (N + 1).
+    float pulses = filter.revolutions * pulsesPerRevolution;
+    float beta = pulses / (pulses + 1.0f);
+
+    filter.alphaTable[0] = 1.0f;
+    for(uint8_t i = 1; i <= _ADAPTIVE_TABLE_SIZE; i++)
+    {
+      filter.alphaTable[i] = filter.alphaTable[i - 1] * beta;
+    }
+
+    return filter;
+  }
+
+  /**
+   * @brief Return the adaptive filter gain for an update. It needs only multiplies.
+   * @param newPulses is the number of pulses from the last update.
+   * @param edgeAge is the time from the last edge. [us]
+   * @return alpha = beta^newPulses. It is 0 after the edge timeout, so a stopped shaft shows 0 at once.
+   */
+  inline float adaptiveAlpha(const AdaptiveFilterStructure &filter, uint32_t newPulses, uint32_t edgeAge)
+  {
+    if(edgeAge > _EDGE_TIMEOUT)
+    {
+      return 0;
+    }
+
+    float alpha = 1.0f;
+    while( (newPulses > _ADAPTIVE_TABLE_SIZE) && (alpha > 1e-6f) )
+    {
+      alpha *= filter.alphaTable[_ADAPTIVE_TABLE_SIZE];
+      newPulses -= _ADAPTIVE_TABLE_SIZE;
+    }
+
+    return (newPulses <= _ADAPTIVE_TABLE_SIZE) ? alpha * filter.alphaTable[newPulses] : alpha;
+  }
+
+  /**
+    @struct EdgeStateStructure
+    @brief Last two periods of a channel and the time of the edge that ended the last one.
+  */
+  struct EdgeStateStructure
+  {
+    /// @brief Time of the last edge. [us]
+    uint32_t timestamp;
+
+    /// @brief Period that ended at the last edge. A value of 0 means there is no valid period. [us]
+    uint32_t period;
+
+    /// @brief Period before the last period. A value of 0 means there is no valid period. [us]
+    uint32_t prevPeriod;
+  };
+
+  /**
+   * @brief Update an edge state on a new edge.
+   * @param valid is false if the period that ends at this edge is not valid. eg: the first edge after init().
+   */
+  inline void edgeState(EdgeStateStructure &state, uint32_t timestamp, uint32_t period, bool valid)
+  {
+    state.prevPeriod = state.period;
+    state.period = valid ? period : 0;
+    state.timestamp = timestamp;
+  }
+
+  /**
+   * @brief Estimate the RPM value at a time from an edge state.  
+   * The RPM of each period is placed at the middle of the period. The line through the last two points is
+   * interpolated or extrapolated to the requested time.
+   * @param t is the requested time. It can be before or after the last edge. [us]
+   * @return Estimated RPM. It is 0 if there is no valid period or the edge timeout is passed. [RPM]
+   * @note - While no new edge arrives, the estimate is limited to the speed of a period that ends at t,
+   * so a slowing shaft is followed before its next edge.
+   */
+  inline float estimateRPM(const EdgeStateStructure &state, uint32_t t)
+  {
+    int32_t age = (int32_t)(t - state.timestamp);
+
+    if( (state.period == 0) || (age > (int32_t)_EDGE_TIMEOUT) )
+    {
+      return 0;
+    }
+
+    float rpm = _RPM_US / (float)state.period;
+    float fromMiddle = (float)age + 0.5f * (float)state.period;
+
+    if(state.prevPeriod != 0)
+    {
+      float slope = (rpm - _RPM_US / (float)state.prevPeriod) / (0.5f * ((float)state.period + (float)state.prevPeriod));
+      rpm += slope * fromMiddle;
+    }
+
+    if( (age > 0) && ((uint32_t)age > state.period) )
+    {
+      float limit = _RPM_US / (float)age;
+      rpm = (rpm < limit) ? rpm : limit;
+    }
+
+    return (rpm > 0) ? rpm : 0;
+  }
+
+  /**
+    @struct AngleStateStructure
+    @brief Shaft position at the last mark edge.
+  */
+  struct AngleStateStructure
+  {
+    /// @brief Time of the last mark edge. [us]
+    uint32_t timestamp;
+
+    /// @brief Period that ended at the last mark edge. A value of 0 means there is no valid period. [us]
+    uint32_t period;
+
+    /// @brief Mark number of the last edge in the revolution. 0 is the index mark.
+    uint16_t mark;
+
+    /// @brief Number of complete revolutions.
+    int32_t revolutions;
+  };
+
+  /**
+   * @brief Update an angle state on a new mark edge.
+   * @param marks is the number of marks in one revolution.
+   * @param useIndex is true if revolutions are counted by the index pulse. The mark number stops at marks - 1 until the index.
+   * @param index is true if the index pulse arrived before this edge. This edge is mark 0.
+   * @param valid is false if the period that ends at this edge is not valid. eg: the first edge after init().
+   */
+  inline void angleEdge(AngleStateStructure &state, uint16_t marks, bool useIndex, bool index, uint32_t timestamp, uint32_t period, bool valid)
+  {
+    if(index == true)
+    {
+      state.mark = 0;
+      state.revolutions++;
+    }
+    else if(state.mark + 1 < marks)
+    {
+      state.mark++;
+    }
+    else if(useIndex == false)
+    {
+      state.mark = 0;
+      state.revolutions++;
+    }
+
+    state.period = valid ? period : 0;
+    state.timestamp = timestamp;
+  }
+
+  /**
+   * @brief Move an angle state back by pulses marks. It undoes corrected missing pulses that were a speed step.
+   * @param marks is the number of marks in one revolution.
+   * @param useIndex is true if revolutions are counted by the index pulse. The mark number stops at 0 until the next index.
+   */
+  inline void angleUndo(AngleStateStructure &state, uint16_t marks, bool useIndex, uint8_t pulses)
+  {
+    for(uint8_t i = 0; i < pulses; i++)
+    {
+      if(state.mark > 0)
+      {
+        state.mark--;
+      }
+      else if(useIndex == false)
+      {
+        state.mark = marks - 1;
+        state.revolutions--;
+      }
+    }
+  }
+
+  /**
+   * @brief Estimate the shaft angle at a time from an angle state.  
+   * The angle is interpolated from the last mark edge with the last period. It never passes the next mark before its edge.
+   * @param markStep is 1 / marks. [revolution]
+   * @param t is the requested time. [us]
+   * @return Angle in the revolution. 0 ... 1. [revolution]
+   */
+  inline float estimateAngle(const AngleStateStructure &state, float markStep, uint32_t t)
+  {
+    float position = (float)state.mark;
+
+    int32_t age = (int32_t)(t - state.timestamp);
+
+    if( (state.period != 0) && (age > 0) )
+    {
+      position += ((uint32_t)age < state.period) ? (float)age / (float)state.period : 1.0f;
+    }
+
+    return position * markStep;
+  }
+
+  /**
+   * @enum PulseClass
+   * @brief Classification of an edge period against the predicted period.
+   */
+  enum class PulseClass : uint8_t
+  {
+    NORMAL = 0,                   ///< The period is about the predicted period, or a slow down. It is used as it is.
+    MISSING,                      ///< The period is about n times the predicted period. It is split into n periods.
+    EXTRA,                        ///< The period and the last short fragment sum to the predicted period. They are merged.
+    SUSPECT,                      ///< The period is short. It is kept as a fragment until the next edge and not used.
+    RESYNC                        ///< The last fragment was a real pulse, or a speed step. The prediction restarts from the period.
+  };
+
+  /**
+    @struct PulseClassifierStructure
+    @brief Missing and extra pulse classifier state.
+  */
+  struct PulseClassifierStructure
+  {
+    /// @brief Period tolerance. [1/256] A value of 0 means the classifier is disabled.
+    uint16_t tolerance;
+
+    /// @brief Maximum number of consecutive missing pulses that are corrected.
+    uint8_t maxMissing;
+
+    /// @brief Predicted period. A value of 0 means there is no prediction. [us]
+    uint32_t expected;
+
+    /// @brief Short period kept from the last edge. A value of 0 means there is no fragment. [us]
+    uint32_t fragment;
+
+    /// @brief Number of corrected missing pulses.
+    uint32_t missing;
+
+    /// @brief Number of merged extra pulses.
+    uint32_t extra;
+
+    /// @brief Last correction: pulses - 1 for MISSING, 1 for EXTRA, 0 for others. 
+    /// A correction on two edges in a row is a speed step, so the last one is undone.
+    uint8_t lastCorrection;
+
+    /// @brief Last class that is not SUSPECT.
+    PulseClass last;
+  };
+
+  /**
+   * @brief Create a pulse classifier.
+   * @param tolerance is the period tolerance. eg: 0.2 means +-20%. It must be less than 1/3. A value of 0 means it is disabled.
+   * @param maxMissing is the maximum number of consecutive missing pulses that are corrected.
+   */
+  inline PulseClassifierStructure makePulseClassifier(float tolerance, uint8_t maxMissing)
+  {
+    PulseClassifierStructure classifier = {(uint16_t)(tolerance * 256.0f + 0.5f), maxMissing, 0, 0, 0, 0, 0, PulseClass::NORMAL};
+    return classifier;
+  }
+
+  /// @brief Return true if period is n times expected within the classifier tolerance. Only integer math.
+  inline bool _pulseMatch(const PulseClassifierStructure &classifier, uint32_t period, uint32_t expected, uint32_t n)
+  {
+    // 64-bit products, so long dropouts (error above 16.7 s) and large targets do not wrap.
+    uint64_t target = (uint64_t)expected * n;
+    uint64_t error = (period > target) ? (period - target) : (target - period);
+    return (error << 8) <= target * classifier.tolerance;
+  }
+
+  /**
+   * @brief Classify an edge period and correct missing or extra pulses.
+   * @param period is the time from the last edge. [us]
+   * @param outPeriod is the corrected period. It is valid if pulses is not 0. [us]
+   * @param pulses is the number of real pulses that end at this edge. 0 means the edge is not used.
+   * @note - It runs in the edge interrupt with integer math and one division for missing pulses.
+   */
+  inline PulseClass classifyPulse(PulseClassifierStructure &classifier, uint32_t period, uint32_t &outPeriod, uint8_t &pulses)
+  {
+    outPeriod = period;
+    pulses = 1;
+
+    PulseClass result = PulseClass::NORMAL;
+    PulseClass last = classifier.last;
+
+    if(classifier.fragment != 0)
+    {
+      uint32_t sum = classifier.fragment + period;
+      classifier.fragment = 0;
+
+      if( (last != PulseClass::EXTRA) && _pulseMatch(classifier, sum, classifier.expected, 1) )
+      {
+        // A glare double trigger split one period.
+        classifier.extra++;
+        classifier.lastCorrection = 1;
+        classifier.expected = sum;
+        classifier.last = PulseClass::EXTRA;
+        outPeriod = sum;
+        return PulseClass::EXTRA;
+      }
+
+      // The fragment was a real pulse. eg: a fast speed up.
+      pulses = 2;
+      result = PulseClass::RESYNC;
+    }
+    else if( (classifier.expected != 0) && (_pulseMatch(classifier, period, classifier.expected, 1) == false) )
+    {
+      if(period < classifier.expected)
+      {
+        classifier.fragment = period;
+        pulses = 0;
+        return PulseClass::SUSPECT;
+      }
+
+      for(uint8_t n = 2; (n <= classifier.maxMissing + 1) && (last != PulseClass::MISSING); n++)
+      {
+        if(_pulseMatch(classifier, period, classifier.expected, n))
+        {
+          // A dropped reflection joined n periods.
+          classifier.missing += n - 1;
+          classifier.lastCorrection = n - 1;
+          outPeriod = period / n;
+          classifier.expected = outPeriod;
+          classifier.last = PulseClass::MISSING;
+          pulses = n;
+          return PulseClass::MISSING;
+        }
+      }
+
+      // A slow down.
+      result = (last == PulseClass::MISSING) ? PulseClass::RESYNC : PulseClass::NORMAL;
+    }
+
+    if(result == PulseClass::RESYNC)
+    {
+      // A correction on two edges in a row is a speed step, not a pulse error.
+      if(last == PulseClass::EXTRA)
+      {
+        classifier.extra -= classifier.lastCorrection;
+      }
+      else if(last == PulseClass::MISSING)
+      {
+        classifier.missing -= classifier.lastCorrection;
+      }
+    }
+
+    classifier.lastCorrection = 0;
+    classifier.expected = period;
+    classifier.last = result;
+    return result;
+  }
+
+  /**
+   * @enum ToothEvent
+   * @brief Result of the missing-tooth decoder for an edge.
+   */
+  enum class ToothEvent : uint8_t
+  {
+    UNLOCKED = 0,                 ///< The decoder is not locked to the gap pattern.
+    TOOTH,                        ///< A tooth edge in a locked revolution.
+    INDEX                         ///< The first tooth after the gap. It is the once-per-revolution index, tooth 0.
+  };
+
+  /**
+    @struct ToothDecoderStructure
+    @brief Missing-tooth trigger wheel decoder state. eg: 36-1 or 60-2 wheels.
+  */
+  struct ToothDecoderStructure
+  {
+    /// @brief Tooth edges since the last gap.
+    uint16_t teeth;
+
+    /// @brief Real teeth between the last two gaps. A value of 0 means unknown.
+    uint16_t lastTeeth;
+
+    /// @brief Missing teeth in the last gap.
+    uint8_t missing;
+
+    /// @brief Detected tooth positions in one revolution. Real teeth + missing teeth. It is valid if locked.
+    uint16_t pulsesPerRevolution;
+
+    /// @brief Tooth number of the last edge. 0 is the first tooth after the gap.
+    uint16_t tooth;
+
+    /// @brief true if two revolutions in a row had the same gap pattern.
+    bool locked;
+
+    /// @brief Number of locked revolutions.
+    uint32_t revolutions;
+
+    /// @brief Number of sync losses. The gap pattern changed or a gap was not found.
+    uint32_t syncLoss;
+  };
+
+  /// @brief Reset the tooth decoder. The counters are kept.
+  inline void resetToothDecoder(ToothDecoderStructure &decoder)
+  {
+    decoder.teeth = 0;
+    decoder.lastTeeth = 0;
+    decoder.tooth = 0;
+    decoder.locked = false;
+  }
+
+  /**
+   * @brief Decode one edge of a missing-tooth wheel from the last two periods. O(1) per edge.  
+   * A period more than 1.5 times the previous one is a gap. The number of teeth between two gaps and the gap width give 
+   * the pulses per revolution. The decoder locks when two revolutions in a row have the same pattern.
+   * @param period is the period that ends at this edge. [us]
+   * @param prevPeriod is the period before it. A value of 0 means unknown. [us]
+   * @param pulses is the number of tooth positions that end at this edge. It is missing + 1 at the index edge.
+   */
+  inline ToothEvent decodeTooth(ToothDecoderStructure &decoder, uint32_t period, uint32_t prevPeriod, uint8_t &pulses)
+  {
+    pulses = 1;
+
+    bool gap = (prevPeriod != 0) && (period / 2 > prevPeriod - prevPeriod / 4);
+
+    if(gap == false)
+    {
+      decoder.teeth++;
+
+      if(decoder.locked == false)
+      {
+        return ToothEvent::UNLOCKED;
+      }
+
+      if(decoder.teeth >= decoder.lastTeeth)
+      {
+        // The gap was not found where it is expected.
+        decoder.syncLoss++;
+        resetToothDecoder(decoder);
+        return ToothEvent::UNLOCKED;
+      }
+
+      decoder.tooth++;
+      return ToothEvent::TOOTH;
+    }
+
+    // Only at the gap: one division per revolution.
+    uint8_t missing = (uint8_t)((period + prevPeriod / 2) / prevPeriod - 1);
+    uint16_t teeth = decoder.teeth + 1;
+    bool same = (teeth == decoder.lastTeeth) && (missing == decoder.missing);
+
+    if( (decoder.locked == true) && (same == false) )
+    {
+      decoder.syncLoss++;
+      decoder.locked = false;
+    }
+    else if( (decoder.locked == false) && (same == true) )
+    {
+      decoder.locked = true;
+      decoder.pulsesPerRevolution = teeth + missing;
+    }
+
+    decoder.lastTeeth = teeth;
+    decoder.missing = missing;
+    decoder.teeth = 0;
+    decoder.tooth = 0;
+
+    if(decoder.locked == false)
+    {
+      return ToothEvent::UNLOCKED;
+    }
+
+    decoder.revolutions++;
+    pulses = missing + 1;
+    return ToothEvent::INDEX;
+  }
+
+  /**
+    @struct CaptureStructure
+    @brief Compressed edge capture in a user byte ring.  
+    Every edge is stored as the zig-zag varint of its period minus the previous period. Near constant speed takes 1 byte per edge.
+    When the ring is full the oldest edges are dropped, so it keeps the last edges.
+    @note - Create it with makeCapture().
+  */
+  struct CaptureStructure
+  {
+    /// @brief Ring buffer. Its size is a power of 2.
+    uint8_t *buffer;
+
+    /// @brief Ring size - 1.
+    uint32_t mask;
+
+    /// @brief Free running index of the next byte to write.
+    uint32_t head;
+
+    /// @brief Free running index of the oldest record.
+    uint32_t tail;
+
+    /// @brief Number of edge records in the ring.
+    uint32_t count;
+
+    /// @brief Time and period of the last edge. [us]
+    uint32_t headTime;
+    uint32_t headPeriod;
+
+    /// @brief Time and period of the edge before the oldest record. They are the decoding base. [us]
+    uint32_t tailTime;
+    uint32_t tailPeriod;
+
+    /// @brief true after the first edge. The first edge only sets the time base.
+    bool started;
+  };
+
+  /**
+    @struct CaptureCursorStructure
+    @brief Iterator over the edges of a capture, from the oldest to the last.
+    @note - Start it with captureBegin() and step it with captureNext().
+  */
+  struct CaptureCursorStructure
+  {
+    /// @brief Free running index of the next record and the end of the records.
+    uint32_t index;
+    uint32_t end;
+
+    /// @brief Time and period of the current edge. [us]
+    uint32_t timestamp;
+    uint32_t period;
+  };
+
+  /**
+   * @brief Create an empty capture.
+   * @param buffer is the ring buffer.
+   * @param size is the ring size. [bytes] It must be a power of 2 and at least 16.
+   * @return The capture. Its buffer is nullptr if the parameters are not valid.
+   */
+  inline CaptureStructure makeCapture(uint8_t *buffer, uint32_t size)
+  {
+    bool valid = (buffer != nullptr) && (size >= 16) && ((size & (size - 1)) == 0);
+    return {valid ? buffer : nullptr, size - 1, 0, 0, 0, 0, 0, 0, 0, false};
+  }
+
+  /**
+   * @brief Read the varint record at a ring index.
+   * @param index is the free running index. It is moved to the next record.
+   * @return The period change of the record. [us]
+   */
+  inline int32_t _captureRead(const CaptureStructure &capture, uint32_t &index)
+  {
+    uint32_t value = 0;
+    uint8_t shift = 0;
+    uint8_t byte;
+
+    do
+    {
+      byte = capture.buffer[index++ & capture.mask];
+      value |= (uint32_t)(byte & 0x7F) << shift;
+      shift += 7;
+    } while( (byte & 0x80) != 0 );
+
+    // Zig-zag decoding.
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+  }
+
+  /**
+   * @brief Add an edge to a capture. It is called in the edge interrupt.
+   * @param timestamp is the edge time. [us]
+   * @note - It costs O(1): at most 5 bytes are written and at most 5 old records are dropped.
+   */
+  inline void captureEdge(CaptureStructure &capture, uint32_t timestamp)
+  {
+    if(capture.started == false)
+    {
+      capture.started = true;
+      capture.headTime = timestamp;
+      capture.tailTime = timestamp;
+      return;
+    }
+
+    uint32_t period = timestamp - capture.headTime;
+    int32_t delta = (int32_t)(period - capture.headPeriod);
+    // Zig-zag encoding: small changes of both signs give small values.
+    uint32_t value = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+    uint32_t length = 1 + (value >= (1u << 7)) + (value >= (1u << 14)) + (value >= (1u << 21)) + (value >= (1u << 28));
+
+    while( (capture.head - capture.tail) + length > capture.mask + 1 )
+    {
+      // Drop the oldest record. Its values move the decoding base.
+      capture.tailPeriod += (uint32_t)_captureRead(capture, capture.tail);
+      capture.tailTime += capture.tailPeriod;
+      capture.count--;
+    }
+
+    while(value >= 0x80)
+    {
+      capture.buffer[capture.head++ & capture.mask] = (uint8_t)(value | 0x80);
+      value >>= 7;
+    }
+    capture.buffer[capture.head++ & capture.mask] = (uint8_t)value;
+
+    capture.headTime = timestamp;
+    capture.headPeriod = period;
+    capture.count++;
+  }
+
+  /**
+   * @brief Start an iterator at the oldest edge of a capture.
+   * @note - The capture must not be changed while it is read.
+   */
+  inline void captureBegin(const CaptureStructure &capture, CaptureCursorStructure &cursor)
+  {
+    cursor.index = capture.tail;
+    cursor.end = capture.head;
+    cursor.timestamp = capture.tailTime;
+    cursor.period = capture.tailPeriod;
+  }
+
+  /**
+   * @brief Decode the next edge of a capture. Its time and period are in the cursor.
+   * @return true if successful. false if there is no more edge.
+   */
+  inline bool captureNext(const CaptureStructure &capture, CaptureCursorStructure &cursor)
+  {
+    if(cursor.index == cursor.end)
+    {
+      return false;
+    }
+
+    cursor.period += (uint32_t)_captureRead(capture, cursor.index);
+    cursor.timestamp += cursor.period;
+
+    return true;
+  }
+
+  /// @brief Maximum number of trigger capture slots.
+  constexpr uint8_t _TRIGGER_SLOTS_MAX = 8;
+
+  /**
+   * @enum TriggerEvent
+   * @brief Trigger conditions of the triggered capture.
+   */
+  enum class TriggerEvent : uint8_t
+  {
+    NONE = 0,                     ///< No trigger.
+    RPM_ABOVE,                    ///< The raw RPM value is above the limit.
+    RPM_BELOW,                    ///< The raw RPM value is below the limit.
+    SLEW,                         ///< The raw RPM change rate is above the limit.
+    STALL,                        ///< The channel is stalled or the edges timed out.
+    EXTERNAL                      ///< External trigger call.
+  };
+
+  /**
+    @struct TriggerSlotStructure
+    @brief Information of one trigger capture slot.
+  */
+  struct TriggerSlotStructure
+  {
+    /// @brief Trigger condition. NONE if the slot is not captured yet.
+    TriggerEvent event;
+
+    /// @brief Trigger time. [us]
+    uint32_t timestamp;
+
+    /// @brief Number of edges of the slot written before the trigger.
+    uint32_t trigger;
+
+    /// @brief Number of edges of the slot written in total.
+    uint32_t end;
+  };
+
+  /**
+    @struct TriggerCaptureStructure
+    @brief Pre/post trigger capture of edge timestamps in slots of a user buffer.  
+    The active slot is a ring of the last edges. A trigger lets it record the post-trigger edges and then the next slot becomes active, 
+    so the captured edges are never copied.
+    @note - Create it with makeTriggerCapture().
+  */
+  struct TriggerCaptureStructure
+  {
+    /// @brief Buffer of slots * (pre + post) edge timestamps.
+    uint32_t *buffer;
+
+    /// @brief Number of pre-trigger and post-trigger edges of a slot.
+    uint16_t pre;
+    uint16_t post;
+
+    /// @brief Number of slots.
+    uint8_t slots;
+
+    /// @brief Active slot. It is equal to slots when all slots are captured.
+    uint8_t active;
+
+    /// @brief Write position in the ring of the active slot.
+    uint16_t position;
+
+    /// @brief Post-trigger edges left. 0 means no trigger is pending.
+    uint16_t remaining;
+
+    /// @brief Slot information.
+    TriggerSlotStructure slot[_TRIGGER_SLOTS_MAX];
+  };
+
+  /**
+   * @brief Create an empty trigger capture.
+   * @param buffer is the buffer of slots * (pre + post) edge timestamps.
+   * @param pre is the number of pre-trigger edges.
+   * @param post is the number of post-trigger edges.
+   * @param slots is the number of slots. 1 to _TRIGGER_SLOTS_MAX.
+   * @return The capture. Its buffer is nullptr if the parameters are not valid.
+   */
+  inline TriggerCaptureStructure makeTriggerCapture(uint32_t *buffer, uint16_t pre, uint16_t post, uint8_t slots)
+  {
+    TriggerCaptureStructure capture;
+
+    bool valid = (buffer != nullptr) && ((uint32_t)pre + post >= 2) && ((uint32_t)pre + post <= 0xFFFF) && (slots >= 1) && (slots <= _TRIGGER_SLOTS_MAX);
+
+    capture.buffer = valid ? buffer : nullptr;
+    capture.pre = pre;
+    capture.post = post;
+    capture.slots = valid ? slots : 0;
+    capture.active = 0;
+    capture.position = 0;
+    capture.remaining = 0;
+
+    for(uint8_t i = 0; i < _TRIGGER_SLOTS_MAX; i++)
+    {
+      capture.slot[i] = {TriggerEvent::NONE, 0, 0, 0};
+    }
+
+    return capture;
+  }
+
+  /**
+   * @brief Add an edge to the trigger capture. It is called in the edge interrupt.
+   * @note - Until a trigger fires it is only one ring write.
+   */
+  inline void triggerEdge(TriggerCaptureStructure &capture, uint32_t timestamp)
+  {
+    if(capture.active >= capture.slots)
+    {
+      return;
+    }
+
+    uint16_t size = capture.pre + capture.post;
+    capture.buffer[(uint32_t)capture.active * size + capture.position] = timestamp;
+    capture.position = (capture.position + 1 < size) ? capture.position + 1 : 0;
+    capture.slot[capture.active].end++;
+
+    if( (capture.remaining != 0) && (--capture.remaining == 0) )
+    {
+      // The slot is complete. The next slot records from now.
+      capture.active++;
+      capture.position = 0;
+    }
+  }
+
+  /**
+   * @brief Fire a trigger in the active slot.
+   * @param timestamp is the trigger time. [us]
+   * @note - It must not be interrupted by triggerEdge().
+   * @return true if successful. false if a trigger is pending or all slots are captured.
+   */
+  inline bool triggerFire(TriggerCaptureStructure &capture, TriggerEvent event, uint32_t timestamp)
+  {
+    if( (capture.active >= capture.slots) || (capture.remaining != 0) )
+    {
+      return false;
+    }
+
+    TriggerSlotStructure &slot = capture.slot[capture.active];
+    slot.event = event;
+    slot.timestamp = timestamp;
+    slot.trigger = slot.end;
+
+    capture.remaining = capture.post;
+
+    if(capture.post == 0)
+    {
+      capture.active++;
+      capture.position = 0;
+    }
+
+    return true;
+  }
+
+  /**
+   * @brief Copy the edges of a captured slot in time order.
+   * @param edges is the output array of edge timestamps. [us]
+   * @param size is the size of the output array.
+   * @param preEdges is the number of copied edges before the trigger.
+   * @return The number of copied edges. 0 if the slot is not captured.
+   */
+  inline uint16_t triggerRead(const TriggerCaptureStructure &capture, uint8_t slot, uint32_t *edges, uint16_t size, uint16_t &preEdges)
+  {
+    preEdges = 0;
+
+    if( (slot >= capture.active) || (slot >= capture.slots) )
+    {
+      return 0;
+    }
+
+    const TriggerSlotStructure &info = capture.slot[slot];
+    uint16_t ring = capture.pre + capture.post;
+    // The ring keeps the last edges. Early triggers have less pre-trigger edges.
+    uint32_t count = (info.end < ring) ? info.end : ring;
+    uint32_t first = info.end - count;
+
+    if(count > size)
+    {
+      // The last edges are copied.
+      first += count - size;
+      count = size;
+    }
+
+    for(uint32_t i = 0; i < count; i++)
+    {
+      edges[i] = capture.buffer[(uint32_t)slot * ring + (first + i) % ring];
+    }
+
+    preEdges = (info.trigger > first) ? (uint16_t)(info.trigger - first) : 0;
+
+    return (uint16_t)count;
+  }
+
+  /// @brief Maximum number of RPM history tiers.
+  constexpr uint8_t _HISTORY_TIERS_MAX = 4;
+
+  /**
+    @struct HistoryPointStructure
+    @brief One point of the RPM history. [RPM]
+  */
+  struct HistoryPointStructure
+  {
+    float min;
+    float mean;
+    float max;
+  };
+
+  /**
+    @struct HistoryStructure
+    @brief Tiered RPM history in a user buffer of tiers * size points.  
+    Each tier is a ring of points. A point of a tier aggregates factor points (or samples for tier 0) of the tier below with min/mean/max.
+    @note - Create it with makeHistory().
+  */
+  struct HistoryStructure
+  {
+    /// @brief Point buffer. The ring of tier n starts at points + n * size.
+    HistoryPointStructure *points;
+
+    /// @brief Number of points of each tier.
+    uint16_t size;
+
+    /// @brief Number of tiers.
+    uint8_t tiers;
+
+    /// @brief Number of lower tier points (samples for tier 0) per point of each tier.
+    uint16_t factor[_HISTORY_TIERS_MAX];
+
+    /// @brief Number of points written in each tier since start. It is free running.
+    uint32_t count[_HISTORY_TIERS_MAX];
+
+    /// @brief Open point of each tier. The mean value is the sum of the aggregated means.
+    HistoryPointStructure open[_HISTORY_TIERS_MAX];
+
+    /// @brief Number of aggregated values in the open point of each tier.
+    uint16_t openCount[_HISTORY_TIERS_MAX];
+  };
+
+  /**
+   * @brief Create an empty RPM history.
+   * @param points is the point buffer of tiers * size points.
+   * @param size is the number of points of each tier.
+   * @param tiers is the number of tiers. 1 to _HISTORY_TIERS_MAX.
+   * @param factors is the array of tiers aggregation factors. Each value must be at least 1. eg: {1, 100, 100}
+   * @return The history. Its points is nullptr if the parameters are not valid.
+   */
+  inline HistoryStructure makeHistory(HistoryPointStructure *points, uint16_t size, uint8_t tiers, const uint16_t *factors)
+  {
+    HistoryStructure history;
+
+    bool valid = (points != nullptr) && (factors != nullptr) && (size > 0) && (tiers >= 1) && (tiers <= _HISTORY_TIERS_MAX);
+
+    for(uint8_t i = 0; i < _HISTORY_TIERS_MAX; i++)
+    {
+      history.factor[i] = (valid && (i < tiers)) ? factors[i] : 0;
+      history.count[i] = 0;
+      history.open[i] = {0, 0, 0};
+      history.openCount[i] = 0;
+
+      if( (i < tiers) && (history.factor[i] == 0) )
+      {
+        valid = false;
+      }
+    }
+
+    history.points = valid ? points : nullptr;
+    history.size = size;
+    history.tiers = valid ? tiers : 0;
+
+    return history;
+  }
+
+  /**
+   * @brief Add an RPM sample to the history. Completed points are propagated to the upper tiers.
+   * @note - It costs O(tiers) in the worst case and O(1) on average.
+   */
+  inline void historyAdd(HistoryStructure &history, float RPM)
+  {
+    HistoryPointStructure point = {RPM, RPM, RPM};
+
+    for(uint8_t i = 0; i < history.tiers; i++)
+    {
+      HistoryPointStructure &open = history.open[i];
+
+      if(history.openCount[i] == 0)
+      {
+        open = point;
+      }
+      else
+      {
+        open.min = (point.min < open.min) ? point.min : open.min;
+        open.max = (point.max > open.max) ? point.max : open.max;
+        open.mean += point.mean;
+      }
+
+      if(++history.openCount[i] < history.factor[i])
+      {
+        return;
+      }
+
+      // The point is complete. All aggregated points have the same weight, so the mean of means is exact.
+      point = {open.min, open.mean / (float)history.factor[i], open.max};
+      history.points[(uint32_t)i * history.size + history.count[i] % history.size] = point;
+      history.count[i]++;
+      history.openCount[i] = 0;
+    }
+  }
+
+  /**
+   * @brief Return the number of available points of a tier.
+   */
+  inline uint16_t historyAvailable(const HistoryStructure &history, uint8_t tier)
+  {
+    if(tier >= history.tiers)
+    {
+      return 0;
+    }
+
+    return (history.count[tier] < history.size) ? (uint16_t)history.count[tier] : history.size;
+  }
+
+  /**
+   * @brief Return the point of a tier at an age.
+   * @param age is the point age. 0 is the last point. It must be less than historyAvailable().
+   */
+  inline HistoryPointStructure historyPoint(const HistoryStructure &history, uint8_t tier, uint16_t age)
+  {
+    return history.points[(uint32_t)tier * history.size + (history.count[tier] - 1 - age) % history.size];
+  }
+
+  /**
+   * @brief Select the finest tier that covers a time span with a number of points.
+   * @param span is the time span in samples of tier 0 input (update() calls).
+   * @param points is the maximum number of points.
+   * @return The tier number. The last tier if no tier covers the span.
+   */
+  inline uint8_t historyTier(const HistoryStructure &history, uint32_t span, uint16_t points)
+  {
+    uint64_t samples = 1;
+
+    for(uint8_t i = 0; i < history.tiers; i++)
+    {
+      samples *= history.factor[i];
+      // Points needed for the span in this tier.
+      uint64_t needed = (span + samples - 1) / samples;
+
+      if( (needed <= points) && (needed <= history.size) )
+      {
+        return i;
+      }
+    }
+
+    return (history.tiers > 0) ? history.tiers - 1 : 0;
+  }
+
+  /**
+    @struct HistogramStructure
+    @brief Time-at-speed histogram (load spectrum) in user arrays.  
+    Bin 0 is below the first RPM edge, bin n is from edge n - 1 to edge n and the last bin is above the last edge.
+    @note - Create it with makeHistogram().
+  */
+  struct HistogramStructure
+  {
+    /// @brief Period edges of the bins in descending order. [us]
+    uint32_t *periodEdges;
+
+    /// @brief Time in each bin. There are edges + 1 bins. [us]
+    uint64_t *bins;
+
+    /// @brief Number of bin edges.
+    uint16_t edges;
+  };
+
+  /**
+   * @brief Create a histogram and clear its bins.
+   * @param RPMEdges is the array of bin edges in ascending order. [RPM]
+   * @param edges is the number of bin edges.
+   * @param periodEdges is the array of edges values for the bin edges converted to periods.
+   * @param bins is the array of edges + 1 bins.
+   * @return The histogram. Its bins is nullptr if the parameters are not valid.
+   */
+  inline HistogramStructure makeHistogram(const float *RPMEdges, uint16_t edges, uint32_t *periodEdges, uint64_t *bins)
+  {
+    bool valid = (RPMEdges != nullptr) && (periodEdges != nullptr) && (bins != nullptr) && (edges > 0) && (edges < 0xFFFF);
+
+    for(uint16_t i = 0; valid && (i < edges); i++)
+    {
+      if( (RPMEdges[i] <= 0) || ( (i > 0) && (RPMEdges[i] <= RPMEdges[i - 1]) ) )
+      {
+        valid = false;
+        break;
+      }
+
+      // RPM >= RPMEdges[i] means period <= periodEdges[i].
+      periodEdges[i] = (uint32_t)(_RPM_US / RPMEdges[i]);
+    }
+
+    if(valid == false)
+    {
+      return {nullptr, nullptr, 0};
+    }
+
+    for(uint32_t i = 0; i <= edges; i++)
+    {
+      bins[i] = 0;
+    }
+
+    return {periodEdges, bins, edges};
+  }
+
+  /**
+   * @brief Return the bin of a period with a binary search of the period edges.
+   * @param period is the period of one revolution. [us]
+   */
+  inline uint16_t histogramBin(const HistogramStructure &histogram, uint32_t period)
+  {
+    uint16_t low = 0;
+    uint16_t high = histogram.edges;
+
+    // The bin is the number of edges that the speed reached.
+    while(low < high)
+    {
+      uint16_t middle = (uint16_t)((low + high) >> 1);
+
+      if(period <= histogram.periodEdges[middle])
+      {
+        low = middle + 1;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+
+    return low;
+  }
+
+  /**
+   * @brief Add time to the bin of a period. It is called in the edge interrupt.
+   * @param period is the period of one revolution. [us]
+   * @param time is the time at this speed. eg: the time from the last edge. [us]
+   * @note - It costs O(log(edges)).
+   */
+  inline void histogramAdd(HistogramStructure &histogram, uint32_t period, uint32_t time)
+  {
+    histogram.bins[histogramBin(histogram, period)] += time;
+  }
+
+  /// @brief Number of period jitter histogram bins. The last bin also counts larger values.
+  constexpr uint8_t _JITTER_BINS = 24;
+
+  /**
+   * @brief Return the log2 bin of a period jitter value. Bin 0 is 0 us and bin n is 2^(n-1) to 2^n - 1 us.
+   * @param jitter is the absolute difference of a period and its predicted period. [us]
+   * @note - It is one CLZ instruction on Cortex-M3/M4/M7.
+   */
+  inline uint8_t jitterBin(uint32_t jitter)
+  {
+    uint8_t bin = (jitter == 0) ? 0 : (uint8_t)(32 - __builtin_clz(jitter));
+
+    return (bin < _JITTER_BINS) ? bin : _JITTER_BINS - 1;
+  }
+
+  /**
+   * @enum Interpolation
+   * @brief Interpolation of the resampler between the speed points.
+   */
+  enum class Interpolation : uint8_t
+  {
+    LINEAR = 0,                   ///< Linear interpolation. The latency is one point.
+    CUBIC                         ///< Catmull-Rom cubic interpolation with non-uniform point spacing. The latency is two points.
+  };
+
+  /**
+    @struct ResamplerStructure
+    @brief Resampler of irregular speed points (one per edge) to a uniform sample clock.
+    @note - Create it with makeResampler(). Add points with resamplePoint() and read the samples with resampleNext().
+  */
+  struct ResamplerStructure
+  {
+    /// @brief Sample interval. [us]
+    float interval;
+
+    /// @brief Interpolation mode.
+    Interpolation mode;
+
+    /// @brief Number of points. The last point is in time[3] and value[3].
+    uint8_t points;
+
+    /// @brief Times of the last 4 points. [us]
+    uint32_t time[4];
+
+    /// @brief Values of the last 4 points.
+    float value[4];
+
+    /// @brief true if the sample clock is started.
+    bool started;
+
+    /// @brief Time of the next sample. [us]
+    uint32_t next;
+
+    /// @brief Fractional part of the next sample time. [us]
+    float phase;
+  };
+
+  /**
+   * @brief Create a resampler.
+   * @param rate is the sample rate. [Hz]
+   */
+  inline ResamplerStructure makeResampler(float rate, Interpolation mode)
+  {
+    return {(rate > 0) ? 1000000.0f / rate : 0, mode, 0, {0, 0, 0, 0}, {0, 0, 0, 0}, false, 0, 0};
+  }
+
+  /**
+   * @brief Restart the resampler. The next points start a new stream. eg: after a stall.
+   */
+  inline void resampleReset(ResamplerStructure &resampler)
+  {
+    resampler.points = 0;
+    resampler.started = false;
+  }
+
+  /**
+   * @brief Add a point. Point times must increase.
+   * @param time is the point time. [us]
+   */
+  inline void resamplePoint(ResamplerStructure &resampler, uint32_t time, float value)
+  {
+    for(uint8_t i = 0; i < 3; i++)
+    {
+      resampler.time[i] = resampler.time[i + 1];
+      resampler.value[i] = resampler.value[i + 1];
+    }
+    resampler.time[3] = time;
+    resampler.value[3] = value;
+
+    if(resampler.points < 4)
+    {
+      resampler.points++;
+    }
+  }
+
+  /**
+   * @brief Calculate the next sample if the points cover its time.
+   * @param timestamp is the sample time. [us]
+   * @return true if a sample is calculated. false if more points are needed.
+   */
+  inline bool resampleNext(ResamplerStructure &resampler, uint32_t &timestamp, float &value)
+  {
+    // Segment p1-p2 of the last points. Linear uses the last two points and cubic one point more on each side.
+    bool cubic = (resampler.mode == Interpolation::CUBIC);
+    uint8_t first = cubic ? 1 : 2;
+
+    if(resampler.points < (cubic ? 4 : 2))
+    {
+      return false;
+    }
+
+    uint32_t t1 = resampler.time[first];
+    uint32_t t2 = resampler.time[first + 1];
+
+    if(resampler.started == false)
+    {
+      resampler.started = true;
+      resampler.next = t1;
+      resampler.phase = 0;
+    }
+
+    int32_t offset = (int32_t)(resampler.next - t1);
+    uint32_t length = t2 - t1;
+
+    if( (offset < 0) || ((uint32_t)offset >= length) )
+    {
+      return false;
+    }
+
+    float u = ((float)offset + resampler.phase) / (float)length;
+    float p1 = resampler.value[first];
+    float p2 = resampler.value[first + 1];
+
+    if(cubic == false)
+    {
+      value = p1 + u * (p2 - p1);
+    }
+    else
+    {
+      // Catmull-Rom tangents from the neighbour points, scaled to the segment length.
+      float p0 = resampler.value[0];
+      float p3 = resampler.value[3];
+      float m1 = (p2 - p0) * (float)length / (float)(t2 - resampler.time[0]);
+      float m2 = (p3 - p1) * (float)length / (float)(resampler.time[3] - t1);
+      float u2 = u * u;
+      float u3 = u2 * u;
+
+      value = (2 * u3 - 3 * u2 + 1) * p1 + (u3 - 2 * u2 + u) * m1 + (3 * u2 - 2 * u3) * p2 + (u3 - u2) * m2;
+    }
+
+    timestamp = resampler.next;
+
+    resampler.phase += resampler.interval;
+    uint32_t step = (uint32_t)resampler.phase;
+    resampler.next += step;
+    resampler.phase -= (float)step;
+
+    return true;
+  }
+
+  /**
+    @struct OrderStructure
+    @brief Angle grid of the order tracking. The angle unit is 1 / (samples * marks) revolution, so the grid is exact in integers.
+    @note - Create it with makeOrder().
+  */
+  struct OrderStructure
+  {
+    /// @brief Samples per revolution.
+    uint16_t samples;
+
+    /// @brief Marks per revolution.
+    uint16_t marks;
+
+    /// @brief Angle of the next sample from the start mark of the segment. [1 / (samples * marks) revolution]
+    uint32_t position;
+  };
+
+  /**
+   * @brief Create an order tracking angle grid.
+   * @param samples is the number of samples per revolution.
+   * @param marks is the number of marks per revolution.
+   */
+  inline OrderStructure makeOrder(uint16_t samples, uint16_t marks)
+  {
+    return {samples, marks, 0};
+  }
+
+  /**
+   * @brief Calculate the next sample time in a segment between two mark edges. The speed is constant in the segment.
+   * @param start is the time of the start edge. [us]
+   * @param length is the segment time. [us]
+   * @param steps is the number of marks of the segment. It is more than 1 over a gap of missing teeth.
+   * @param time is the sample time. [us]
+   * @return true if a sample time is calculated. false if the segment is finished. The next call is for the next segment.
+   */
+  inline bool orderNext(OrderStructure &order, uint32_t start, uint32_t length, uint8_t steps, uint32_t &time)
+  {
+    // A mark is samples units and a sample is marks units.
+    uint32_t end = (uint32_t)steps * order.samples;
+
+    if(order.position >= end)
+    {
+      order.position -= end;
+      return false;
+    }
+
+    time = start + (uint32_t)(((uint64_t)order.position * length) / end);
+    order.position += order.marks;
+
+    return true;
+  }
+
+  /**
+    @struct ChannelStructure
+    @brief RPM values of one channel.
+  */
+  struct ChannelStructure
+  {
+    /// @brief Raw input RPM signal measurement values. [RPM].
+    float rawRPM;
+
+    /// @brief RPM value after low-pass filter and MIN/MAX saturation. [RPM].
+    float RPM;
+  };
+
+  /**
+   * @enum WarmupState
+   * @brief Warm-up state of a channel. A valid period needs two edges after init() or a stall.
+   */
+  enum class WarmupState : uint8_t
+  {
+    WAIT_FIRST_EDGE = 0,          ///< No edge yet. The next edge only starts a period.
+    WAIT_SECOND_EDGE,             ///< One edge received. The next edge gives the first valid period.
+    SEED,                         ///< First valid period received. The next update seeds the filter with it.
+    RUNNING                       ///< Normal operation.
+  };
+
+  /**
+   * @brief Edge interrupt part of the warm-up state machine.
+   * @return true if the period that ends at this edge is valid.
+   */
+  inline bool warmupEdge(WarmupState &state)
+  {
+    if(state == WarmupState::WAIT_FIRST_EDGE)
+    {
+      state = WarmupState::WAIT_SECOND_EDGE;
+      return false;
+    }
+
+    if(state == WarmupState::WAIT_SECOND_EDGE)
+    {
+      state = WarmupState::SEED;
+    }
+
+    return true;
+  }
+
+  /**
+   * @brief Check the update frequency.
+   * @param dt is the time from the last update. [us]
+   * @return true if an update is due.
+   */
+  inline bool updateDue(const FilterConfigStructure &config, uint32_t dt)
+  {
+    return dt >= config.updateInterval;
+  }
+
+  /**
+   * @brief Return the low-pass filter gain.
+   * @param dt is the time from the last update. [us]
+   * @return alpha = 1.0 / (1.0 + 2pi * FILTER_FRQ * dt). It is 0 if the filter is disabled.
+   * @note - If UPDATE_FRQ is not 0, it is the precomputed value at the nominal interval 1 / UPDATE_FRQ, not at the measured dt. 
+   * A late update() uses the nominal gain, so its cutoff frequency is a little lower than FILTER_FRQ.
+   */
+  inline float filterAlpha(const FilterConfigStructure &config, uint32_t dt)
+  {
+    if( (config.UPDATE_FRQ > 0) || (config.FILTER_FRQ <= 0) )
+    {
+      return config.alpha;
+    }
+
+    return 1.0f / (1.0f + config.filterK * (float)dt);
+  }
+
+  /**
+   * @brief Update the raw and filtered RPM values of one channel from its last period.
+   * @param channel is the channel values.
+   * @param alpha is the low-pass filter gain from filterAlpha() or adaptiveAlpha(). A value of 0 means no filter.
+   * @param period is the last period time value. [us]
+   * @param edgeAge is the time from the last edge. [us]
+   * @param invalid is true if there is no valid period. eg: the channel is stalled or warming up.
+   * @param dt is the time from the last update. [us]
+   * @return true if the filtered RPM value is updated. false if the raw value is rejected by slew or MAX check.
+   */
+  inline bool updateChannel(const FilterConfigStructure &config, ChannelStructure &channel, float alpha, uint32_t period, uint32_t edgeAge, bool invalid, uint32_t dt)
+  {
+    bool zero = (edgeAge > _EDGE_TIMEOUT) || (invalid == true);
+    float temp = zero ? 0.0f : _RPM_US / (float)period;
+
+    // temp > MIN uses the slew check and temp < MIN gives 0. A value of exactly MIN passes through.
+    bool aboveMin = (zero == false) && (period < config.maxPeriod);
+    bool belowMin = (zero == true) || (period > config.zeroPeriod);
+
+    if(aboveMin)
+    {
+      if( (temp - channel.rawRPM) > _MAX_SLEW * (float)dt )
+      {
+        channel.rawRPM = temp;
+        return false;
+      }
+    }
+
+    channel.rawRPM = temp;
+
+    if(belowMin == true)
+    {
+      temp = 0;
+    }
+    else if(period < config.minPeriod)
+    {
+      // temp > MAX
+      return false;
+    }
+
+    if(alpha > 0)
+    {
+      channel.RPM += (1.0f - alpha) * (temp - channel.RPM);
+    }
+    else
+    {
+      channel.RPM = temp;
+    }
+
+    return true;
+  }
+
+  /**
+   * @brief Seed the raw and filtered RPM values with a period, without slew check and filter lag.
+   * @return true if successful. false if the period is out of the MIN/MAX range.
+   */
+  inline bool seedChannel(const FilterConfigStructure &config, ChannelStructure &channel, uint32_t period)
+  {
+    if( (period > config.zeroPeriod) || (period < config.minPeriod) )
+    {
+      return false;
+    }
+
+    channel.rawRPM = _RPM_US / (float)period;
+    channel.RPM = channel.rawRPM;
+
+    return true;
+  }
+
+  /**
+   * @brief update() part of the warm-up state machine and the RPM update of one channel.  
+   * A timeout or stall restarts the warm-up. The first valid period seeds the filter, so the real speed is shown after the second edge.
+   * @param state is the warm-up state of the channel.
+   * @note - Other parameters are the same as updateChannel().
+   * @return true if the filtered RPM value is updated.
+   */
+  inline bool updateChannelWarmup(const FilterConfigStructure &config, ChannelStructure &channel, WarmupState &state, float alpha, uint32_t period, uint32_t edgeAge, bool stalled, uint32_t dt)
+  {
+    if( (edgeAge > _EDGE_TIMEOUT) || (stalled == true) )
+    {
+      state = WarmupState::WAIT_FIRST_EDGE;
+    }
+
+    if( (state == WarmupState::SEED) && seedChannel(config, channel, period) )
+    {
+      state = WarmupState::RUNNING;
+      return true;
+    }
+
+    return updateChannel(config, channel, alpha, period, edgeAge, (state < WarmupState::SEED), dt);
+  }
+}
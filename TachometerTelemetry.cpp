@@ -0,0 +1,257 @@
+
+// ######################################################################
+// Include libraries:
+
+#include "TachometerTelemetry.h"
+
+using namespace TachometerTelemetry_Frame;
+
+// ##########################################################################
+// TachometerTelemetry class:
+
+TachometerTelemetry::TachometerTelemetry()
+{
+  errorCode = ErrorCode::NONE;
+
+  _huart = nullptr;
+  _bufferFrames = 0;
+  _active = 0;
+  _txBusy = false;
+  _lostEdges = 0;
+  _lostFrames = 0;
+  _sentFrames = 0;
+
+  for(uint8_t i = 0; i < 2; i++)
+  {
+    _buffers[i].frames = nullptr;
+    _buffers[i].reserved = 0;
+    _buffers[i].closed = 0;
+    _buffers[i].busy = false;
+  }
+
+  for(uint8_t i = 0; i < 3; i++)
+  {
+    _channels[i].frame = nullptr;
+    _channels[i].buffer = 0;
+    _channels[i].last = 0;
+    _channels[i].sequence = 0;
+  }
+}
+
+bool TachometerTelemetry::init(UART_HandleTypeDef *huart, FrameStructure *buffer, uint16_t frames)
+{
+  // The DMA transmit size is 16 bits.
+  if( (huart == nullptr) || (buffer == nullptr) || (frames < 2) || ((frames & 1) != 0) || (frames / 2 * sizeof(FrameStructure) > 0xFFFF) )
+  {
+    errorCode = ErrorCode::PARAMETERS_INVALID;
+    return false;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  _huart = huart;
+  _bufferFrames = frames / 2;
+  _active = 0;
+  _txBusy = false;
+
+  for(uint8_t i = 0; i < 2; i++)
+  {
+    _buffers[i].frames = buffer + i * _bufferFrames;
+    _buffers[i].reserved = 0;
+    _buffers[i].closed = 0;
+    _buffers[i].busy = false;
+  }
+
+  for(uint8_t i = 0; i < 3; i++)
+  {
+    _channels[i].frame = nullptr;
+  }
+
+  __set_PRIMASK(primask);
+
+  return true;
+}
+
+void TachometerTelemetry::push(uint8_t channel, uint32_t timestamp)
+{
+  if( (_huart == nullptr) || (channel == 0) || (channel > 3) )
+  {
+    return;
+  }
+
+  ChannelStructure &state = _channels[channel - 1];
+  FrameStructure *frame = state.frame;
+
+  if(frame != nullptr)
+  {
+    uint32_t delta = timestamp - state.last;
+
+    if(delta <= 0xFFFF)
+    {
+      // Written in place in the DMA buffer.
+      frame->delta[frame->count - 1] = (uint16_t)delta;
+      frame->count++;
+      state.last = timestamp;
+
+      if(frame->count == _EDGES)
+      {
+        _close(state);
+      }
+      return;
+    }
+
+    // The delta does not fit in 16 bits. A new frame starts with a new base timestamp.
+    _close(state);
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  frame = _reserve(state);
+  __set_PRIMASK(primask);
+
+  if(frame == nullptr)
+  {
+    _lostEdges++;
+    return;
+  }
+
+  frame->sync = _SYNC;
+  frame->channel = channel;
+  frame->count = 1;
+  frame->timestamp = timestamp;
+  frame->sequence = state.sequence++;
+
+  state.last = timestamp;
+  state.frame = frame;
+}
+
+void TachometerTelemetry::flush(void)
+{
+  if(_huart == nullptr)
+  {
+    return;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  for(uint8_t i = 0; i < 3; i++)
+  {
+    if(_channels[i].frame != nullptr)
+    {
+      _close(_channels[i]);
+    }
+  }
+
+  // The active buffer is sent when the other buffer is free to take its place.
+  BufferStructure &active = _buffers[_active];
+  BufferStructure &other = _buffers[_active ^ 1];
+
+  if( (active.reserved > 0) && (other.busy == false) && (other.reserved == 0) )
+  {
+    uint8_t last = _active;
+    _active ^= 1;
+    _send(last);
+  }
+
+  __set_PRIMASK(primask);
+}
+
+void TachometerTelemetry::txCompleteHandler(void)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  for(uint8_t i = 0; i < 2; i++)
+  {
+    if(_buffers[i].busy == true)
+    {
+      _sentFrames += _buffers[i].reserved;
+      _buffers[i].reserved = 0;
+      _buffers[i].closed = 0;
+      _buffers[i].busy = false;
+    }
+  }
+
+  _txBusy = false;
+
+  _send(0);
+  _send(1);
+
+  __set_PRIMASK(primask);
+}
+
+FrameStructure* TachometerTelemetry::_reserve(ChannelStructure &channel)
+{
+  BufferStructure *buffer = &_buffers[_active];
+
+  if(buffer->reserved >= _bufferFrames)
+  {
+    BufferStructure &other = _buffers[_active ^ 1];
+
+    if( (other.busy == true) || (other.reserved != 0) )
+    {
+      // Both buffers are full.
+      return nullptr;
+    }
+
+    uint8_t last = _active;
+    _active ^= 1;
+    _send(last);
+    buffer = &other;
+  }
+
+  channel.buffer = _active;
+  return buffer->frames + buffer->reserved++;
+}
+
+void TachometerTelemetry::_close(ChannelStructure &channel)
+{
+  FrameStructure *frame = channel.frame;
+
+  // The frame is only written by its channel, so the CRC is calculated with interrupts enabled.
+  frame->crc = frameCRC(*frame);
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  channel.frame = nullptr;
+  _buffers[channel.buffer].closed++;
+  _send(channel.buffer);
+
+  __set_PRIMASK(primask);
+}
+
+void TachometerTelemetry::_send(uint8_t buffer)
+{
+  BufferStructure &state = _buffers[buffer];
+
+  // A buffer is ready when it is not active any more (or it is full) and all its frames are closed.
+  bool ready = (_txBusy == false) && (state.busy == false) && (state.reserved > 0) && (state.closed == state.reserved) &&
+               ( (buffer != _active) || (state.reserved >= _bufferFrames) );
+
+  if(ready == false)
+  {
+    return;
+  }
+
+  uint16_t size = (uint16_t)(state.reserved * sizeof(FrameStructure));
+
+  #if defined(STM32H7)
+    SCB_CleanDCache_by_Addr((uint32_t*)state.frames, size);
+  #endif
+
+  state.busy = true;
+  _txBusy = true;
+
+  if(HAL_UART_Transmit_DMA(_huart, (uint8_t*)state.frames, size) != HAL_OK)
+  {
+    errorCode = ErrorCode::TRANSMIT_FAILED;
+    _lostFrames += state.reserved;
+    state.reserved = 0;
+    state.closed = 0;
+    state.busy = false;
+    _txBusy = false;
+  }
+}
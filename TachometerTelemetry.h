@@ -0,0 +1,213 @@
+#pragma once
+
+// ##################################################################
+// Library information:
+/*
+TachometerTelemetry - Binary streaming of raw TachometerOptical edge timestamps over UART DMA.
+Edge interrupts write delta encoded frames directly in DMA buffers (ping-pong), so no bytes are copied.
+For more information read README.md file.
+*/
+// ###################################################################
+// Include libraaries:
+
+#include "mcu_select.h"
+
+#if defined(STM32F1)
+#include "stm32f1xx_hal.h"      // HAL library for STM32F1 series
+#elif defined(STM32F4)
+#include "stm32f4xx_hal.h"      // HAL library for STM32F4 series
+#elif defined(STM32H7)
+#include "stm32h7xx_hal.h"      // HAL library for STM32H7 series
+#else
+#error "Unsupported MCU family. Please define a valid target (e.g., STM32F1, STM32F4, STM32H7)."
+#endif
+
+#include "TachometerTelemetryFrame.h"
+
+// ###################################################################################
+//  General function declarations:
+
+namespace TachometerTelemetry_Namespace
+{
+  /**
+   * @brief Error messages table.
+   * @note - The order of messages must match the order of TachometerTelemetry::ErrorCode values.
+   */
+  constexpr const char* const _ERROR_MESSAGES[] =
+  {
+    "No error.",
+    "Error TachometerTelemetry: One or some parameters is not correct.",
+    "Error TachometerTelemetry: The UART DMA transmit is failed."
+  };
+
+  /// @brief Number of messages in the error messages table.
+  constexpr uint8_t _ERROR_MESSAGES_NUM = sizeof(_ERROR_MESSAGES) / sizeof(_ERROR_MESSAGES[0]);
+}
+
+// ##################################################################################
+// TachometerTelemetry class
+
+/**
+  @class TachometerTelemetry
+  @brief Zero-copy binary telemetry of raw edge timestamps.
+  Each channel fills its open frame in place in the active DMA buffer. Full buffers are sent with HAL_UART_Transmit_DMA()
+  while the other buffer is filled.
+*/
+class TachometerTelemetry
+{
+  public:
+
+    /**
+     * @enum ErrorCode
+     * @brief Error codes of TachometerTelemetry objects.
+     */
+    enum class ErrorCode : uint8_t
+    {
+      NONE = 0,                     ///< No error.
+      PARAMETERS_INVALID,           ///< One or some parameters is not correct.
+      TRANSMIT_FAILED               ///< HAL_UART_Transmit_DMA() returned an error. The frames of the buffer are lost.
+    };
+
+    /// @brief Last error accured for object.
+    ErrorCode errorCode;
+
+    /**
+     * @brief Get the error message string for an error code.
+     * @return Pointer to a null terminated string.
+     */
+    static constexpr const char* errorString(ErrorCode code)
+    {
+      return ((uint8_t)code < TachometerTelemetry_Namespace::_ERROR_MESSAGES_NUM) ? TachometerTelemetry_Namespace::_ERROR_MESSAGES[(uint8_t)code] : "Error TachometerTelemetry: Unknown error.";
+    }
+
+    /**
+    * @brief Default constructor. Init default value of variables.
+    */
+    TachometerTelemetry();
+
+    /**
+     * @brief Initialize object.
+     * @param huart is the UART handle. Its TX DMA must be configured outside of the object.
+     * @param buffer is the frame buffer. It is split into two ping-pong buffers.
+     * @param frames is the number of frames in the buffer. It must be even, at least 2 and at most 2046.
+     * @note - On STM32H7 the buffer must be 32 bytes aligned, or in a non-cacheable memory region. The data cache is cleaned before each transmit.
+     * @note - Call txCompleteHandler() in HAL_UART_TxCpltCallback() for this UART.
+     * @return true if succeeded.
+     */
+    bool init(UART_HandleTypeDef *huart, TachometerTelemetry_Frame::FrameStructure *buffer, uint16_t frames);
+
+    /**
+     * @brief Add an edge timestamp of a channel. It is called in the edge interrupt by TachometerOptical objects.
+     * @param channel is the channel number. 1, 2 or 3.
+     * @param timestamp is the edge time. [us]
+     * @note - The edge that closes a frame (every _EDGES edges, or a delta above 65535 us) also calculates the frame CRC in the interrupt: 
+     * 62 table lookups, about 400 cycles (2.5 us at 168 MHz) on Cortex-M4. The other edges take a few tens of cycles.
+     */
+    void push(uint8_t channel, uint32_t timestamp);
+
+    /**
+     * @brief Close the open frames and send the active buffer. Call it periodically in the main loop. eg: every 10 ms.
+     * It limits the latency of slow channels. Frames are sent with less than _EDGES edges.
+     */
+    void flush(void);
+
+    /**
+     * @brief UART DMA transmit complete handler.
+     * @note - Call it in HAL_UART_TxCpltCallback() for the UART of this object.
+     */
+    void txCompleteHandler(void);
+
+    /// @brief Return the number of edges that are lost because both buffers were full.
+    uint32_t getLostEdgeCount(void) {return _lostEdges;};
+
+    /// @brief Return the number of frames that are lost because a DMA transmit failed.
+    uint32_t getLostFrameCount(void) {return _lostFrames;};
+
+    /// @brief Return the number of frames that are sent.
+    uint32_t getFrameCount(void) {return _sentFrames;};
+
+  private:
+
+    /**
+      @struct BufferStructure
+      @brief State of one ping-pong buffer.
+    */
+    struct BufferStructure
+    {
+      /// @brief First frame of the buffer.
+      TachometerTelemetry_Frame::FrameStructure *frames;
+
+      /// @brief Number of frames given to channels.
+      uint16_t reserved;
+
+      /// @brief Number of closed frames. The buffer can be sent when all reserved frames are closed.
+      uint16_t closed;
+
+      /// @brief true while the buffer is sent by DMA.
+      bool busy;
+    };
+
+    /**
+      @struct ChannelStructure
+      @brief Frame state of one channel.
+    */
+    struct ChannelStructure
+    {
+      /// @brief Open frame. A value of nullptr means no frame is open.
+      TachometerTelemetry_Frame::FrameStructure *frame;
+
+      /// @brief Buffer number of the open frame.
+      uint8_t buffer;
+
+      /// @brief Last edge time. [us]
+      uint32_t last;
+
+      /// @brief Sequence number of the next frame.
+      uint16_t sequence;
+    };
+
+    /// @brief UART handle.
+    UART_HandleTypeDef *_huart;
+
+    /// @brief Ping-pong buffers.
+    BufferStructure _buffers[2];
+
+    /// @brief Number of frames in each buffer.
+    uint16_t _bufferFrames;
+
+    /// @brief Buffer number that gives frames to channels.
+    uint8_t _active;
+
+    /// @brief true while a DMA transmit is running.
+    bool _txBusy;
+
+    /// @brief Channel frame states. Cell 0 is for channel 1.
+    ChannelStructure _channels[3];
+
+    /// @brief Number of lost edges.
+    volatile uint32_t _lostEdges;
+
+    /// @brief Number of frames lost by failed transmits.
+    volatile uint32_t _lostFrames;
+
+    /// @brief Number of sent frames.
+    volatile uint32_t _sentFrames;
+
+    /**
+     * @brief Give a frame of the active buffer to a channel. It switches the buffers if the active buffer is full.
+     * @note - It must be called with interrupts disabled.
+     * @return The frame. nullptr if both buffers are full.
+     */
+    TachometerTelemetry_Frame::FrameStructure* _reserve(ChannelStructure &channel);
+
+    /**
+     * @brief Close the open frame of a channel. Calculate its CRC and send its buffer if it is ready.
+     */
+    void _close(ChannelStructure &channel);
+
+    /**
+     * @brief Start the DMA transmit of a buffer if it is ready and the UART is free.
+     * @note - It must be called with interrupts disabled.
+     */
+    void _send(uint8_t buffer);
+};
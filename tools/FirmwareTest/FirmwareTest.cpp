@@ -0,0 +1,355 @@
+// ##################################################################
+// Tool information:
+/*
+FirmwareTest - Host tests of the TachometerOptical firmware class.
+TachometerOptical.cpp is built on the host with the HAL stub headers in stub/. The test sets the time, calls the edge interrupt
+callback and update() and checks the public results.
+With -DTACHOMETER_OPTICAL_FREERTOS the stub FreeRTOS layer in stub/ is used and the wait API is tested with host threads.
+It exits with 1 if a check fails.
+For more information read tools/README.md file.
+*/
+// ###################################################################
+// Include libraaries:
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+#include "TachometerOptical.h"
+
+// ###################################################################################
+//  HAL stub functions:
+
+GPIO_TypeDef gA, gB, gC, gD, gE, gF, gG, gH, gI;
+
+/// @brief Test time. [us]
+static volatile uint32_t testTime = 0;
+
+unsigned long TimerControl::micros(void) {return testTime;}
+unsigned long TimerControl::millis(void) {return testTime / 1000;}
+bool TimerControl::getInitState(void) {return true;}
+
+void HAL_GPIO_Init(GPIO_TypeDef*, GPIO_InitTypeDef*) {}
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *port, uint16_t pin) {return (port->IDR & pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;}
+void HAL_NVIC_SetPriority(IRQn_Type, uint32_t, uint32_t) {}
+void HAL_NVIC_EnableIRQ(IRQn_Type) {}
+uint32_t HAL_GetTick(void) {return testTime / 1000;}
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef*, const uint8_t*, uint16_t) {return HAL_OK;}
+
+// ###################################################################################
+//  General definitions:
+
+/// @brief Number of failed checks.
+static int failures = 0;
+
+/// @brief Count and print a failed check.
+#define CHECK(condition) do { if(!(condition)) { failures++; std::printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); } } while(0)
+
+/**
+ * @brief Init a channel 1 object on GPIOA pin 0 with rising edges.
+ */
+static bool initChannel(TachometerOptical &tacho)
+{
+  static TimerControl timer;
+
+  TachometerOptical::setTimerControl(&timer);
+  tacho.parameters.GPIO_PORT = GPIOA;
+  tacho.parameters.GPIO_PIN = GPIO_PIN_0;
+  tacho.parameters.CHANNEL_NUM = 1;
+  tacho.parameters.EDGE_MODE = TachometerOptical::EdgeMode::RISING;
+
+  return tacho.init();
+}
+
+/**
+ * @brief Call the edge interrupt at a time.
+ */
+static void edge(TachometerOptical &tacho, uint32_t t)
+{
+  testTime = t;
+
+  #if defined(TACHOMETER_OPTICAL_FREERTOS)
+    FreeRTOSStub::insideInterrupt() = true;
+    tacho.EXTI_Callback();
+    FreeRTOSStub::insideInterrupt() = false;
+  #else
+    tacho.EXTI_Callback();
+  #endif
+}
+
+/**
+ * @brief Run a constant edge period and call update() every 10 ms.
+ * @param t is the time of the last edge. It is the time of the last edge of the run at return. [us]
+ * @param period is the edge period. [us]
+ * @param duration is the run time. [us]
+ */
+static void run(TachometerOptical &tacho, uint32_t &t, uint32_t period, uint32_t duration)
+{
+  const uint32_t updateStep = 10000;
+  uint32_t end = t + duration;
+  uint32_t nextUpdate = testTime - testTime % updateStep + updateStep;
+
+  while((int32_t)(end - (t + period)) >= 0)
+  {
+    while((int32_t)(t + period - nextUpdate) > 0)
+    {
+      testTime = nextUpdate;
+      TachometerOptical::update();
+      nextUpdate += updateStep;
+    }
+
+    t += period;
+    edge(tacho, t);
+  }
+}
+
+// ###################################################################################
+//  Tests:
+
+/**
+ * @brief The angle estimator counts only locked revolutions of a missing-tooth wheel.
+ * The teeth before the decoder locks are not counted as revolutions.
+ */
+static void testAngleToothLock(void)
+{
+  TachometerOptical tacho;
+  CHECK(initChannel(tacho));
+  CHECK(tacho.setToothDecoder(true));
+  CHECK(tacho.setAngleEstimator(1));
+
+  // 36-1 wheel at 3000 RPM for 20 revolutions.
+  const double toothPeriod = 20000.0 / 36.0;
+  const uint32_t start = 100000;
+
+  for(uint32_t k = 0; k < 20 * 36; k++)
+  {
+    if(k % 36 != 35)
+    {
+      edge(tacho, start + (uint32_t)std::lround(k * toothPeriod));
+    }
+  }
+
+  TachometerOptical::ToothStructure tooth;
+  CHECK(tacho.getToothState(tooth));
+  CHECK(tooth.locked == true);
+  CHECK(tooth.pulsesPerRevolution == 36);
+
+  TachometerOptical::AngleStructure angle;
+  CHECK(tacho.getAngle(angle));
+  CHECK( (angle.revolutions >= 17) && (angle.revolutions <= 20) );
+}
+
+/**
+ * @brief A trigger condition fires once while it is true and fires again after it was false.
+ */
+static void testTriggerEdge(void)
+{
+  TachometerOptical tacho;
+  CHECK(initChannel(tacho));
+  CHECK(TachometerOptical::setRange(100, 20000));
+  CHECK(TachometerOptical::setUpdateFrequency(100));
+
+  static uint32_t buffer[3 * (8 + 4)];
+  CHECK(tacho.setTriggerCapture(buffer, 8, 4, 3));
+  CHECK(tacho.setTriggerConditions(1200, 0, 0, false));
+
+  uint32_t t = 100000;
+  edge(tacho, t);
+
+  // 1000 RPM, then 1500 RPM for 2 s. Only one slot is captured while the speed stays above the limit.
+  run(tacho, t, 60000, 2000000);
+  CHECK(tacho.getTriggerSlotCount() == 0);
+  run(tacho, t, 40000, 2000000);
+  CHECK(tacho.getTriggerSlotCount() == 1);
+
+  // Below the limit and above it again.
+  run(tacho, t, 60000, 1000000);
+  CHECK(tacho.getTriggerSlotCount() == 1);
+  run(tacho, t, 40000, 1000000);
+  CHECK(tacho.getTriggerSlotCount() == 2);
+
+  TachometerOptical_Core::TriggerSlotStructure slot;
+  CHECK(tacho.getTriggerSlot(1, slot));
+  CHECK(slot.event == TachometerOptical_Core::TriggerEvent::RPM_ABOVE);
+}
+
+/**
+ * @brief The gap of a missing-tooth wheel is not counted as jitter with the tooth decoder.
+ */
+static void testJitterToothGap(void)
+{
+  TachometerOptical tacho;
+  CHECK(initChannel(tacho));
+  // update() drains the edge ring before it is full.
+  CHECK(TachometerOptical::setUpdateFrequency(500));
+  CHECK(tacho.setToothDecoder(true));
+  tacho.setJitterHistogram(true);
+
+  // 36-1 wheel at 3000 RPM for 20 revolutions. The edge times are rounded, so the jitter is at most 1 us.
+  const double toothPeriod = 20000.0 / 36.0;
+  const uint32_t start = 100000;
+  uint32_t nextUpdate = start;
+  uint32_t edges = 0;
+
+  for(uint32_t k = 0; k < 20 * 36; k++)
+  {
+    uint32_t t = start + (uint32_t)std::lround(k * toothPeriod);
+
+    if(t >= nextUpdate)
+    {
+      testTime = t;
+      TachometerOptical::update();
+      nextUpdate += 2000;
+    }
+
+    if(k % 36 != 35)
+    {
+      edge(tacho, t);
+      edges++;
+    }
+  }
+  testTime = testTime + 10000;
+  TachometerOptical::update();
+
+  uint32_t bins[TachometerOptical_Core::_JITTER_BINS];
+  CHECK(tacho.getJitterHistogram(bins));
+
+  uint32_t small = bins[0] + bins[1];
+  uint32_t large = 0;
+  for(uint8_t i = 2; i < TachometerOptical_Core::_JITTER_BINS; i++)
+  {
+    large += bins[i];
+  }
+
+  // The first two edges have no prediction and two samples per gap are skipped.
+  CHECK(large == 0);
+  CHECK(small == edges - 2 - 2 * 19);
+}
+
+/**
+ * @brief A 2x slow down is first corrected as a missing pulse and then undone as a speed step. 
+ * The pulse total and the angle estimator count only the real pulses.
+ */
+static void testClassifierSlowDown(void)
+{
+  TachometerOptical tacho;
+  CHECK(initChannel(tacho));
+  CHECK(TachometerOptical::setRange(100, 20000));
+  CHECK(TachometerOptical::setUpdateFrequency(100));
+  CHECK(tacho.setPulseClassifier(0.2f));
+  CHECK(tacho.setAngleEstimator(1));
+
+  uint32_t t = 100000;
+  edge(tacho, t);
+
+  // 1500 RPM for 1 s and 750 RPM for 2 s: 1 + 25 + 25 edges.
+  run(tacho, t, 40000, 1000000);
+  run(tacho, t, 80000, 2000000);
+
+  CHECK(tacho.getTotalPulses() == 51);
+  CHECK(tacho.getMissingPulseCount() == 0);
+
+  TachometerOptical::AngleStructure angle;
+  CHECK(tacho.getAngle(angle));
+  // One mark per revolution. Every edge is one revolution.
+  CHECK(angle.revolutions == 51);
+}
+
+/**
+ * @brief A long pulse period with many pulses per revolution does not wrap the revolution period to a high RPM.
+ */
+static void testRevolutionPeriodOverflow(void)
+{
+  TachometerOptical tacho;
+  CHECK(initChannel(tacho));
+  CHECK(TachometerOptical::setRange(10, 20000));
+  CHECK(TachometerOptical::setUpdateFrequency(100));
+  CHECK(tacho.setPulsesPerRevolution(5000));
+
+  // 860 ms * 5000 is above 2^32 us. A wrapped period is about 5 s (12 RPM). The real speed is below the min RPM.
+  uint32_t t = 100000;
+  edge(tacho, t);
+  run(tacho, t, 860000, 5 * 860000);
+
+  TachometerOptical::MeasurementStructure m;
+  CHECK(tacho.getMeasurement(m));
+  CHECK(m.period == 0xFFFFFFFFu);
+  CHECK(m.RPM == 0);
+}
+
+#if defined(TACHOMETER_OPTICAL_FREERTOS)
+
+/// @brief Return the milliseconds since a time.
+static long elapsedMs(std::chrono::steady_clock::time_point start)
+{
+  return (long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief waitForRevolution() and waitForMeasurement() time out without events and are woken by the edge interrupt and update().
+ */
+static void testWait(void)
+{
+  TachometerOptical tacho;
+  CHECK(initChannel(tacho));
+  CHECK(TachometerOptical::setRange(100, 20000));
+  CHECK(TachometerOptical::setUpdateFrequency(100));
+
+  // Timeout without edges.
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  CHECK(tacho.waitForRevolution(50) == false);
+  CHECK(elapsedMs(start) >= 50);
+
+  // An edge interrupt in another thread wakes the waiting task.
+  std::thread edgeThread([&tacho] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    edge(tacho, 100000);
+  });
+  start = std::chrono::steady_clock::now();
+  CHECK(tacho.waitForRevolution(2000) == true);
+  CHECK(elapsedMs(start) < 1000);
+  edgeThread.join();
+
+  // update() in another task wakes the waiting task.
+  std::thread updateThread([] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    testTime = testTime + 20000;
+    TachometerOptical::update();
+  });
+  start = std::chrono::steady_clock::now();
+  CHECK(tacho.waitForMeasurement(2000) == true);
+  CHECK(elapsedMs(start) < 1000);
+  updateThread.join();
+
+  // Notifications left from the earlier waits do not end a new wait early.
+  start = std::chrono::steady_clock::now();
+  CHECK(tacho.waitForMeasurement(50) == false);
+  CHECK(elapsedMs(start) >= 50);
+}
+
+#endif
+
+// ###################################################################################
+//  Main:
+
+int main(void)
+{
+  testAngleToothLock();
+  testTriggerEdge();
+  testJitterToothGap();
+  testClassifierSlowDown();
+  testRevolutionPeriodOverflow();
+  #if defined(TACHOMETER_OPTICAL_FREERTOS)
+    testWait();
+  #endif
+
+  if(failures > 0)
+  {
+    std::printf("%d checks failed.\n", failures);
+    return 1;
+  }
+
+  std::printf("All checks passed.\n");
+  return 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+// ##################################################################
+// Host stub of the FreeRTOS kernel API used by TachometerOptical, for tools/FirmwareTest.
+// Tasks are host threads. The tick is 1 ms. Task notifications use a mutex and a condition variable per thread.
+// A thread is inside an interrupt while FreeRTOSStub::insideInterrupt is true. The test sets it around edge interrupt calls.
+// ###################################################################
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFUL)
+#define pdMS_TO_TICKS(x) ((TickType_t)(x))
+#define portYIELD_FROM_ISR(x) (void)(x)
+
+/**
+  @struct TaskStructure
+  @brief Notification state of one host thread.
+*/
+struct TaskStructure
+{
+  std::mutex mutex;
+  std::condition_variable condition;
+  uint32_t value = 0;
+};
+
+typedef TaskStructure* TaskHandle_t;
+
+/**
+  @struct TimeOut_t
+  @brief Start time of a timeout.
+*/
+typedef struct
+{
+  std::chrono::steady_clock::time_point start;
+} TimeOut_t;
+
+namespace FreeRTOSStub
+{
+  /// @brief Notification state of the calling thread.
+  inline TaskStructure& currentTask(void)
+  {
+    static thread_local TaskStructure task;
+    return task;
+  }
+
+  /// @brief true while the calling thread runs an interrupt handler.
+  inline bool& insideInterrupt(void)
+  {
+    static thread_local bool inside = false;
+    return inside;
+  }
+}
+
+inline BaseType_t xPortIsInsideInterrupt(void)
+{
+  return FreeRTOSStub::insideInterrupt() ? pdTRUE : pdFALSE;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// ##################################################################
+// Host stub of TimerControl for tools/FirmwareTest. 
+// The time is set by the test (FirmwareTest.cpp), so edges and update() calls run at exact times.
+// ###################################################################
+
+#include <stdint.h>
+
+class TimerControl
+{
+  public:
+
+    /// @brief Return the test time. [us]
+    unsigned long micros(void);
+
+    /// @brief Return the test time. [ms]
+    unsigned long millis(void);
+
+    /// @brief Always true on the host.
+    bool getInitState(void);
+};
@@ -0,0 +1,4 @@
+#pragma once
+
+// Host build of the firmware for tools/FirmwareTest. The STM32F4 HAL stub is used.
+#define STM32F4
@@ -0,0 +1,85 @@
+#pragma once
+
+// ##################################################################
+// Host stub of the STM32F4 HAL and CMSIS core functions used by TachometerOptical, for tools/FirmwareTest.
+// Functions are defined in FirmwareTest.cpp. There are no interrupts on the host, so PRIMASK is a no-op.
+// ###################################################################
+
+#include <stdint.h>
+#include <stddef.h>
+typedef struct { volatile uint32_t IDR; } GPIO_TypeDef;
+typedef struct { uint32_t Pin, Mode, Pull, Speed, Alternate; } GPIO_InitTypeDef;
+typedef enum { GPIO_PIN_RESET = 0, GPIO_PIN_SET } GPIO_PinState;
+typedef enum { HAL_OK = 0, HAL_ERROR, HAL_BUSY, HAL_TIMEOUT } HAL_StatusTypeDef;
+typedef enum { EXTI0_IRQn=6, EXTI1_IRQn, EXTI2_IRQn, EXTI3_IRQn, EXTI4_IRQn, EXTI9_5_IRQn=23, EXTI15_10_IRQn=40 } IRQn_Type;
+extern GPIO_TypeDef gA, gB, gC, gD, gE, gF, gG, gH, gI;
+#define GPIOA (&gA)
+#define GPIOB (&gB)
+#define GPIOC (&gC)
+#define GPIOD (&gD)
+#define GPIOE (&gE)
+#define GPIOH (&gH)
+#define GPIO_PIN_0 ((uint16_t)0x0001)
+#define GPIO_PIN_1 ((uint16_t)0x0002)
+#define GPIO_PIN_2 ((uint16_t)0x0004)
+#define GPIO_PIN_3 ((uint16_t)0x0008)
+#define GPIO_PIN_4 ((uint16_t)0x0010)
+#define GPIO_PIN_5 ((uint16_t)0x0020)
+#define GPIO_PIN_6 ((uint16_t)0x0040)
+#define GPIO_PIN_7 ((uint16_t)0x0080)
+#define GPIO_PIN_8 ((uint16_t)0x0100)
+#define GPIO_PIN_9 ((uint16_t)0x0200)
+#define GPIO_PIN_10 ((uint16_t)0x0400)
+#define GPIO_PIN_11 ((uint16_t)0x0800)
+#define GPIO_PIN_12 ((uint16_t)0x1000)
+#define GPIO_PIN_13 ((uint16_t)0x2000)
+#define GPIO_PIN_14 ((uint16_t)0x4000)
+#define GPIO_PIN_15 ((uint16_t)0x8000)
+#define GPIO_MODE_IT_RISING 0x10110000u
+#define GPIO_MODE_IT_FALLING 0x10210000u
+#define GPIO_MODE_IT_RISING_FALLING 0x10310000u
+#define GPIO_MODE_AF_PP 0x2u
+#define GPIO_NOPULL 0
+#define GPIO_SPEED_FREQ_HIGH 2
+void HAL_GPIO_Init(GPIO_TypeDef*, GPIO_InitTypeDef*);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef*, uint16_t);
+void HAL_NVIC_SetPriority(IRQn_Type, uint32_t, uint32_t);
+void HAL_NVIC_EnableIRQ(IRQn_Type);
+
+#define __HAL_RCC_GPIOA_CLK_ENABLE() do{}while(0)
+#define __HAL_RCC_GPIOB_CLK_ENABLE() do{}while(0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE() do{}while(0)
+#define __HAL_RCC_GPIOD_CLK_ENABLE() do{}while(0)
+#define __HAL_RCC_GPIOE_CLK_ENABLE() do{}while(0)
+#define __HAL_RCC_GPIOH_CLK_ENABLE() do{}while(0)
+
+typedef struct { volatile uint32_t CNT, CCR1, CCR2, CCR3, CCR4, SR, DIER, SMCR; } TIM_TypeDef;
+typedef struct { TIM_TypeDef* Instance; } TIM_HandleTypeDef;
+typedef struct { void* Instance; } UART_HandleTypeDef;
+
+static inline uint32_t __CLZ(uint32_t v) { return v ? __builtin_clz(v) : 32; }
+static inline void __DMB(void) {}
+static inline void __DSB(void) {}
+static inline void __WFE(void) {}
+static inline void __SEV(void) {}
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t) {}
+static inline void __disable_irq(void) {}
+uint32_t HAL_GetTick(void);
+#define TIM_CHANNEL_1 0x0u
+#define TIM_CHANNEL_2 0x4u
+#define TIM_CHANNEL_3 0x8u
+#define TIM_CHANNEL_4 0xCu
+#define TIM_IT_CC1 0x2u
+#define TIM_FLAG_CC1 0x2u
+#define __HAL_TIM_GET_COUNTER(h) ((h)->Instance->CNT)
+#define __HAL_TIM_GET_AUTORELOAD(h) ((h)->Instance->CNT)
+#define __HAL_TIM_SET_COMPARE(h, ch, v) ((h)->Instance->CCR1 = (v))
+#define __HAL_TIM_GET_COMPARE(h, ch) ((h)->Instance->CCR1)
+#define __HAL_TIM_CLEAR_FLAG(h, f) ((h)->Instance->SR = ~(f))
+#define __HAL_TIM_ENABLE_IT(h, i) ((h)->Instance->DIER |= (i))
+#define __HAL_TIM_DISABLE_IT(h, i) ((h)->Instance->DIER &= ~(i))
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef*, const uint8_t*, uint16_t);
+typedef struct { uint32_t NDTR; } DMA_Stream_TypeDef;
+typedef struct { DMA_Stream_TypeDef *Instance; } DMA_HandleTypeDef;
+#define __HAL_DMA_GET_COUNTER(h) ((h)->Instance->NDTR)
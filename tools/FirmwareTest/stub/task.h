@@ -0,0 +1,85 @@
+#pragma once
+
+// ##################################################################
+// Host stub of the FreeRTOS task API used by TachometerOptical, for tools/FirmwareTest. See FreeRTOS.h.
+// ###################################################################
+
+#include "FreeRTOS.h"
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+  return &FreeRTOSStub::currentTask();
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait)
+{
+  TaskStructure &task = FreeRTOSStub::currentTask();
+  std::unique_lock<std::mutex> lock(task.mutex);
+
+  if(ticksToWait == portMAX_DELAY)
+  {
+    task.condition.wait(lock, [&task] {return task.value > 0;});
+  }
+  else
+  {
+    task.condition.wait_for(lock, std::chrono::milliseconds(ticksToWait), [&task] {return task.value > 0;});
+  }
+
+  uint32_t value = task.value;
+  if(value > 0)
+  {
+    task.value = (clearCountOnExit == pdTRUE) ? 0 : value - 1;
+  }
+
+  return value;
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  std::lock_guard<std::mutex> lock(task->mutex);
+  task->value++;
+  task->condition.notify_one();
+
+  return pdTRUE;
+}
+
+inline void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higherPriorityTaskWoken)
+{
+  xTaskNotifyGive(task);
+
+  if(higherPriorityTaskWoken != nullptr)
+  {
+    *higherPriorityTaskWoken = pdTRUE;
+  }
+}
+
+inline void vTaskSetTimeOutState(TimeOut_t *timeOut)
+{
+  timeOut->start = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief Check a timeout like FreeRTOS: the remaining ticks are reduced by the time since the last call and the start time is reset.
+ * @return pdTRUE if the timeout has passed.
+ */
+inline BaseType_t xTaskCheckForTimeOut(TimeOut_t *timeOut, TickType_t *ticksToWait)
+{
+  if(*ticksToWait == portMAX_DELAY)
+  {
+    return pdFALSE;
+  }
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  TickType_t elapsed = (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(now - timeOut->start).count();
+
+  if(elapsed >= *ticksToWait)
+  {
+    *ticksToWait = 0;
+    return pdTRUE;
+  }
+
+  *ticksToWait -= elapsed;
+  timeOut->start += std::chrono::milliseconds(elapsed);
+
+  return pdFALSE;
+}
@@ -0,0 +1,301 @@
+// ##################################################################
+// Tool information:
+/*
+TachometerAnalyzer - Offline batch analyzer for TachometerOptical edge trace files.
+It replays the firmware RPM calculation (TachometerOpticalCore.h) for every channel of every trace file
+in parallel on all cores, and writes per-channel RPM series and summary statistics.
+For more information read tools/README.md file.
+*/
+// ###################################################################
+// Include libraaries:
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "TraceFile.h"
+#include "TachometerSim.h"
+#include "WorkStealingPool.h"
+
+namespace fs = std::filesystem;
+
+// ###################################################################################
+//  General definitions:
+
+/// @brief Minimum trace chunk size parsed by one task. [bytes]
+#define CHUNK_SIZE      (4u << 20)
+
+/**
+  @struct OptionsStructure
+  @brief Command line options.
+*/
+struct OptionsStructure
+{
+  TachometerOptical_Core::FilterConfigStructure config = TachometerOptical_Core::makeFilterConfig(0, 0, 0, 0);
+  float adaptiveRevolutions = 0;
+  float tolerance = 0;
+  uint32_t callPeriod = 100;
+  unsigned threads = 0;
+  std::string outputDir;
+  std::vector<std::string> inputs;
+};
+
+/**
+  @struct SummaryStructure
+  @brief Summary statistics of one channel of one file.
+*/
+struct SummaryStructure
+{
+  std::string file;
+  unsigned channel = 0;
+  size_t edges = 0;
+  size_t samples = 0;
+  double duration = 0;
+  double minRPM = 0;
+  double maxRPM = 0;
+  double meanRPM = 0;
+  double stdRPM = 0;
+  size_t errors = 0;
+};
+
+static void printUsage(void)
+{
+  std::printf(
+    "Usage: TachometerAnalyzer [options] <trace file or directory>...\n"
+    "  -u <Hz>     update frequency. setUpdateFrequency(). Default: 0\n"
+    "  -f <Hz>     filter frequency. setFilterFrequency(). Default: 0\n"
+    "  -r <min>:<max>  RPM range. setRange(). Default: 0:0\n"
+    "  -a <revs>   adaptive filter time constant. setAdaptiveFilter(). Default: 0\n"
+    "  -p <tolerance>  pulse classifier tolerance. setPulseClassifier(). Default: 0\n"
+    "  -c <us>     time between update() calls of the main loop. Default: 100\n"
+    "  -j <n>      number of threads. Default: all cores\n"
+    "  -o <dir>    output directory for <file>.ch<N>.csv RPM series. Default: no series output\n");
+}
+
+static bool parseOptions(int argc, char **argv, OptionsStructure &options)
+{
+  for(int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    bool hasValue = (i + 1 < argc);
+
+    if( (arg == "-u") && hasValue )       options.config.UPDATE_FRQ = std::strtof(argv[++i], nullptr);
+    else if( (arg == "-f") && hasValue )  options.config.FILTER_FRQ = std::strtof(argv[++i], nullptr);
+    else if( (arg == "-a") && hasValue )  options.adaptiveRevolutions = std::strtof(argv[++i], nullptr);
+    else if( (arg == "-p") && hasValue )  options.tolerance = std::strtof(argv[++i], nullptr);
+    else if( (arg == "-c") && hasValue )  options.callPeriod = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+    else if( (arg == "-j") && hasValue )  options.threads = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+    else if( (arg == "-o") && hasValue )  options.outputDir = argv[++i];
+    else if( (arg == "-r") && hasValue )
+    {
+      unsigned min = 0, max = 0;
+      if(std::sscanf(argv[++i], "%u:%u", &min, &max) != 2)
+      {
+        return false;
+      }
+      options.config.MIN = (uint16_t)min;
+      options.config.MAX = (uint16_t)max;
+    }
+    else if( (arg.size() > 1) && (arg[0] == '-') ) return false;
+    else options.inputs.push_back(arg);
+  }
+
+  // Fill the precomputed values like the firmware setters.
+  options.config = TachometerOptical_Core::makeFilterConfig(options.config.MIN, options.config.MAX, options.config.FILTER_FRQ, options.config.UPDATE_FRQ);
+
+  return !options.inputs.empty() && (options.config.MAX >= options.config.MIN) &&
+         (options.config.UPDATE_FRQ >= 0) && (options.config.FILTER_FRQ >= 0) && (options.tolerance >= 0) && (options.tolerance < 0.33f);
+}
+
+/**
+ * @brief Replay one channel, write its RPM series and return its summary.
+ */
+static SummaryStructure analyzeChannel(const OptionsStructure &options, const std::string &file, unsigned channel, const std::vector<uint64_t> &edges)
+{
+  SummaryStructure summary;
+  summary.file = file;
+  summary.channel = channel;
+  summary.edges = edges.size();
+
+  std::vector<TachometerSim::SampleStructure> samples;
+  TachometerSim sim(options.config, options.callPeriod);
+  sim.setAdaptiveFilter(options.adaptiveRevolutions);
+  sim.setPulseClassifier(options.tolerance, 2);
+  sim.run(edges, samples);
+
+  summary.samples = samples.size();
+  if(!samples.empty())
+  {
+    double sum = 0, sum2 = 0;
+    summary.minRPM = samples.front().RPM;
+    summary.maxRPM = samples.front().RPM;
+    for(const TachometerSim::SampleStructure &sample : samples)
+    {
+      summary.minRPM = std::min(summary.minRPM, (double)sample.RPM);
+      summary.maxRPM = std::max(summary.maxRPM, (double)sample.RPM);
+      sum += sample.RPM;
+      sum2 += (double)sample.RPM * sample.RPM;
+    }
+    summary.meanRPM = sum / samples.size();
+    summary.stdRPM = std::sqrt(std::max(0.0, sum2 / samples.size() - summary.meanRPM * summary.meanRPM));
+    summary.duration = (samples.back().timestamp - samples.front().timestamp) / 1000000.0;
+  }
+
+  if(!options.outputDir.empty())
+  {
+    std::string path = (fs::path(options.outputDir) / (fs::path(file).stem().string() + ".ch" + std::to_string(channel) + ".csv")).string();
+    FILE *out = std::fopen(path.c_str(), "w");
+    if(out != nullptr)
+    {
+      std::fprintf(out, "timestamp_us,rawRPM,RPM\n");
+      for(const TachometerSim::SampleStructure &sample : samples)
+      {
+        // %.9g prints float values exactly.
+        std::fprintf(out, "%llu,%.9g,%.9g\n", (unsigned long long)sample.timestamp, sample.rawRPM, sample.RPM);
+      }
+      std::fclose(out);
+    }
+    else
+    {
+      std::fprintf(stderr, "Error TachometerAnalyzer: can not write %s\n", path.c_str());
+    }
+  }
+
+  return summary;
+}
+
+/**
+ * @brief Parse one trace file in parallel chunks and analyze its channels in parallel.
+ */
+static void analyzeFile(WorkStealingPool &pool, const OptionsStructure &options, const std::string &file, std::mutex &resultsMutex, std::vector<SummaryStructure> &results)
+{
+  std::string data;
+  if(TraceFile::readFile(file, data) == false)
+  {
+    std::fprintf(stderr, "Error TachometerAnalyzer: can not read %s\n", file.c_str());
+    return;
+  }
+
+  std::vector<size_t> offsets = TraceFile::splitLines(data, CHUNK_SIZE);
+  std::vector<std::vector<TraceFile::EdgeStructure>> chunks(offsets.size() - 1);
+  std::vector<size_t> chunkErrors(chunks.size(), 0);
+
+  {
+    TaskGroup group(pool);
+    for(size_t i = 0; i < chunks.size(); i++)
+    {
+      group.run([&, i]()
+      {
+        chunkErrors[i] = TraceFile::parse(data.data() + offsets[i], data.data() + offsets[i + 1], chunks[i]);
+      });
+    }
+    group.wait();
+  }
+
+  // Chunks are joined in file order, so the edge order of each channel is kept.
+  std::map<unsigned, std::vector<uint64_t>> channels;
+  size_t errors = 0;
+  for(size_t i = 0; i < chunks.size(); i++)
+  {
+    errors += chunkErrors[i];
+    for(const TraceFile::EdgeStructure &edge : chunks[i])
+    {
+      channels[edge.channel].push_back(edge.timestamp);
+    }
+    std::vector<TraceFile::EdgeStructure>().swap(chunks[i]);
+  }
+
+  std::vector<SummaryStructure> summaries(channels.size());
+  {
+    TaskGroup group(pool);
+    size_t i = 0;
+    for(const auto &channel : channels)
+    {
+      group.run([&, i]()
+      {
+        summaries[i] = analyzeChannel(options, file, channel.first, channel.second);
+      });
+      i++;
+    }
+    group.wait();
+  }
+
+  std::lock_guard<std::mutex> lock(resultsMutex);
+  for(SummaryStructure &summary : summaries)
+  {
+    summary.errors = errors;
+    results.push_back(summary);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  OptionsStructure options;
+  if(parseOptions(argc, argv, options) == false)
+  {
+    printUsage();
+    return 1;
+  }
+
+  std::vector<std::string> files;
+  for(const std::string &input : options.inputs)
+  {
+    if(fs::is_directory(input))
+    {
+      for(const fs::directory_entry &entry : fs::directory_iterator(input))
+      {
+        if(entry.is_regular_file())
+        {
+          files.push_back(entry.path().string());
+        }
+      }
+    }
+    else
+    {
+      files.push_back(input);
+    }
+  }
+  std::sort(files.begin(), files.end());
+
+  if(!options.outputDir.empty())
+  {
+    fs::create_directories(options.outputDir);
+  }
+
+  std::mutex resultsMutex;
+  std::vector<SummaryStructure> results;
+
+  {
+    WorkStealingPool pool(options.threads);
+    TaskGroup group(pool);
+    for(const std::string &file : files)
+    {
+      group.run([&, file]()
+      {
+        analyzeFile(pool, options, file, resultsMutex, results);
+      });
+    }
+    group.wait();
+  }
+
+  std::sort(results.begin(), results.end(), [](const SummaryStructure &a, const SummaryStructure &b)
+  {
+    return (a.file != b.file) ? (a.file < b.file) : (a.channel < b.channel);
+  });
+
+  std::printf("file,channel,edges,updates,duration_s,rpm_min,rpm_mean,rpm_max,rpm_std,bad_lines\n");
+  for(const SummaryStructure &summary : results)
+  {
+    std::printf("%s,%u,%zu,%zu,%.6f,%.9g,%.9g,%.9g,%.9g,%zu\n", summary.file.c_str(), summary.channel, summary.edges, summary.samples,
+                summary.duration, summary.minRPM, summary.meanRPM, summary.maxRPM, summary.stdRPM, summary.errors);
+  }
+
+  return 0;
+}
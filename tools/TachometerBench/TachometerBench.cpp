@@ -0,0 +1,464 @@
+// ##################################################################
+// Tool information:
+/*
+TachometerBench - Filter latency-vs-noise benchmark for TachometerOptical settings.
+Synthetic scenarios (speed steps, ramps, torsional oscillation, jitter, missing pulses, double triggers) and recorded
+trace files are replayed through the firmware code (TachometerSim) for a grid of setUpdateFrequency()/setFilterFrequency()
+values. It reports step-response delay, settling time, RMS error and CPU cost per update.
+For more information read tools/README.md file.
+*/
+// ###################################################################
+// Include libraaries:
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "TraceFile.h"
+#include "TachometerSim.h"
+#include "WorkStealingPool.h"
+
+// ###################################################################################
+//  General definitions:
+
+/**
+  @struct ScenarioStructure
+  @brief Edge stream and true speed of one scenario.
+*/
+struct ScenarioStructure
+{
+  /// @brief Scenario name.
+  std::string name;
+
+  /// @brief Edge times. [us]
+  std::vector<uint64_t> edges;
+
+  /// @brief True speed at a time. [RPM]
+  std::function<double(uint64_t)> truth;
+
+  /// @brief Step time for step response metrics. A value of 0 means the scenario has no step. [us]
+  uint64_t stepTime = 0;
+
+  /// @brief Speed before and after the step. [RPM]
+  double stepFrom = 0;
+  double stepTo = 0;
+
+  /// @brief Errors are measured after this time. [us]
+  uint64_t warmup = 0;
+};
+
+/**
+  @struct ResultStructure
+  @brief Benchmark result of one scenario and one setting.
+*/
+struct ResultStructure
+{
+  std::string scenario;
+  float updateFrq = 0;
+  float filterFrq = 0;
+  double delay = NAN;
+  double settling = NAN;
+  double rmsError = 0;
+  double maxError = 0;
+  double nsPerUpdate = 0;
+  double cyclesPerUpdate = NAN;
+};
+
+/// @brief Scenario length. [us]
+#define SCENARIO_TIME       10000000ULL
+
+/// @brief Settling band. [fraction of step size]
+#define SETTLING_BAND       0.02
+
+static uint64_t cycleCounter(void)
+{
+  #if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+  #else
+  return 0;
+  #endif
+}
+
+/**
+ * @brief Generate edges of a single mark shaft for a speed profile.
+ * @param speed is the true speed at a time. [RPM]
+ */
+static std::vector<uint64_t> generateEdges(const std::function<double(double)> &speed, uint64_t end)
+{
+  std::vector<uint64_t> edges;
+  double t = 1000;
+
+  while(t < end)
+  {
+    // Midpoint integration of one revolution.
+    double period = 60e6 / std::max(1.0, speed(t));
+    period = 60e6 / std::max(1.0, speed(t + period / 2));
+    t += period;
+    edges.push_back((uint64_t)t);
+  }
+
+  return edges;
+}
+
+static std::vector<ScenarioStructure> syntheticScenarios(uint32_t seed)
+{
+  std::vector<ScenarioStructure> scenarios;
+  std::mt19937 random(seed);
+
+  {
+    ScenarioStructure s;
+    s.name = "step_1000_2000";
+    s.stepTime = 4000000;
+    s.stepFrom = 1000;
+    s.stepTo = 2000;
+    s.warmup = 2000000;
+    uint64_t stepTime = s.stepTime;
+    s.truth = [stepTime](uint64_t t){return (t < stepTime) ? 1000.0 : 2000.0;};
+    s.edges = generateEdges([stepTime](double t){return (t < stepTime) ? 1000.0 : 2000.0;}, SCENARIO_TIME);
+    scenarios.push_back(s);
+  }
+
+  {
+    ScenarioStructure s;
+    s.name = "ramp_500_3000";
+    s.warmup = 2000000;
+    auto speed = [](double t){return 500.0 + 2500.0 * std::min(1.0, t / SCENARIO_TIME);};
+    s.truth = [speed](uint64_t t){return speed((double)t);};
+    s.edges = generateEdges(speed, SCENARIO_TIME);
+    scenarios.push_back(s);
+  }
+
+  {
+    ScenarioStructure s;
+    s.name = "torsional_1500_100_5hz";
+    s.warmup = 2000000;
+    auto speed = [](double t){return 1500.0 + 100.0 * std::sin(2 * M_PI * 5.0 * t / 1e6);};
+    s.truth = [speed](uint64_t t){return speed((double)t);};
+    s.edges = generateEdges(speed, SCENARIO_TIME);
+    scenarios.push_back(s);
+  }
+
+  {
+    ScenarioStructure s;
+    s.name = "jitter_1500_2pct";
+    s.warmup = 2000000;
+    s.truth = [](uint64_t){return 1500.0;};
+    s.edges = generateEdges([](double){return 1500.0;}, SCENARIO_TIME);
+    std::normal_distribution<double> noise(0, 0.02 * 40000);
+    for(uint64_t &edge : s.edges)
+    {
+      edge = (uint64_t)std::max(0.0, (double)edge + noise(random));
+    }
+    std::sort(s.edges.begin(), s.edges.end());
+    scenarios.push_back(s);
+  }
+
+  {
+    ScenarioStructure s;
+    s.name = "missing_1500_3pct";
+    s.warmup = 2000000;
+    s.truth = [](uint64_t){return 1500.0;};
+    std::vector<uint64_t> edges = generateEdges([](double){return 1500.0;}, SCENARIO_TIME);
+    std::bernoulli_distribution drop(0.03);
+    for(uint64_t edge : edges)
+    {
+      if(!drop(random))
+      {
+        s.edges.push_back(edge);
+      }
+    }
+    scenarios.push_back(s);
+  }
+
+  {
+    ScenarioStructure s;
+    s.name = "double_1500_3pct";
+    s.warmup = 2000000;
+    s.truth = [](uint64_t){return 1500.0;};
+    std::vector<uint64_t> edges = generateEdges([](double){return 1500.0;}, SCENARIO_TIME);
+    std::bernoulli_distribution extra(0.03);
+    for(uint64_t edge : edges)
+    {
+      s.edges.push_back(edge);
+      if(extra(random))
+      {
+        // Glare: a second trigger shortly after the mark.
+        s.edges.push_back(edge + 4000);
+      }
+    }
+    scenarios.push_back(s);
+  }
+
+  return scenarios;
+}
+
+/**
+ * @brief Make scenarios from a recorded trace file. One scenario per channel.
+ * The true speed is a centered (zero lag) moving average of the per-period speed over 2*halfWindow+1 periods.
+ */
+static std::vector<ScenarioStructure> recordedScenarios(const std::string &file, unsigned halfWindow)
+{
+  std::vector<ScenarioStructure> scenarios;
+  std::string data;
+  if(TraceFile::readFile(file, data) == false)
+  {
+    std::fprintf(stderr, "Error TachometerBench: can not read %s\n", file.c_str());
+    return scenarios;
+  }
+
+  std::vector<TraceFile::EdgeStructure> edges;
+  TraceFile::parse(data.data(), data.data() + data.size(), edges);
+
+  std::map<unsigned, std::vector<uint64_t>> channels;
+  for(const TraceFile::EdgeStructure &edge : edges)
+  {
+    channels[edge.channel].push_back(edge.timestamp);
+  }
+
+  for(const auto &channel : channels)
+  {
+    const std::vector<uint64_t> &e = channel.second;
+    if(e.size() < 2 * halfWindow + 3)
+    {
+      continue;
+    }
+
+    // Reference speed at the middle of each period.
+    std::vector<uint64_t> times;
+    std::vector<double> speeds;
+    for(size_t i = halfWindow + 1; i + halfWindow < e.size(); i++)
+    {
+      double time = (double)(e[i + halfWindow] - e[i - halfWindow - 1]);
+      times.push_back((e[i] + e[i - 1]) / 2);
+      speeds.push_back(60e6 * (2 * halfWindow + 1) / time);
+    }
+
+    ScenarioStructure s;
+    s.name = file + ":ch" + std::to_string(channel.first);
+    s.edges = e;
+    s.warmup = times.front();
+    s.truth = [times, speeds](uint64_t t)
+    {
+      size_t i = std::lower_bound(times.begin(), times.end(), t) - times.begin();
+      if(i == 0) return speeds.front();
+      if(i >= times.size()) return speeds.back();
+      double k = (double)(t - times[i - 1]) / (double)(times[i] - times[i - 1]);
+      return speeds[i - 1] + k * (speeds[i] - speeds[i - 1]);
+    };
+    scenarios.push_back(s);
+  }
+
+  return scenarios;
+}
+
+static ResultStructure runBenchmark(const ScenarioStructure &scenario, float updateFrq, float filterFrq, uint32_t callPeriod, float tolerance)
+{
+  ResultStructure result;
+  result.scenario = scenario.name;
+  result.updateFrq = updateFrq;
+  result.filterFrq = filterFrq;
+
+  TachometerOptical_Core::FilterConfigStructure config = TachometerOptical_Core::makeFilterConfig(0, 0, filterFrq, updateFrq);
+  std::vector<TachometerSim::SampleStructure> samples;
+  TachometerSim sim(config, callPeriod);
+  sim.setPulseClassifier(tolerance, 2);
+  sim.run(scenario.edges, samples);
+
+  // Errors against the true speed.
+  double sum2 = 0;
+  size_t count = 0;
+  for(const TachometerSim::SampleStructure &sample : samples)
+  {
+    if(sample.timestamp < scenario.warmup)
+    {
+      continue;
+    }
+    double error = sample.RPM - scenario.truth(sample.timestamp);
+    sum2 += error * error;
+    result.maxError = std::max(result.maxError, std::fabs(error));
+    count++;
+  }
+  result.rmsError = (count > 0) ? std::sqrt(sum2 / count) : NAN;
+
+  // Step response: 50% crossing delay and settling time into the band around the final value.
+  if(scenario.stepTime > 0)
+  {
+    double half = (scenario.stepFrom + scenario.stepTo) / 2;
+    double band = SETTLING_BAND * std::fabs(scenario.stepTo - scenario.stepFrom);
+    bool rising = scenario.stepTo > scenario.stepFrom;
+    uint64_t settled = 0;
+
+    for(const TachometerSim::SampleStructure &sample : samples)
+    {
+      if(sample.timestamp < scenario.stepTime)
+      {
+        continue;
+      }
+      if( std::isnan(result.delay) && (rising ? (sample.RPM >= half) : (sample.RPM <= half)) )
+      {
+        result.delay = (sample.timestamp - scenario.stepTime) / 1000.0;
+      }
+      if(std::fabs(sample.RPM - scenario.stepTo) > band)
+      {
+        settled = 0;
+      }
+      else if(settled == 0)
+      {
+        settled = sample.timestamp;
+      }
+    }
+    if(settled > 0)
+    {
+      result.settling = (settled - scenario.stepTime) / 1000.0;
+    }
+  }
+
+  // CPU cost of the update() path of one channel.
+  TachometerOptical_Core::ChannelStructure channel = {0, 0};
+  uint32_t dt = (updateFrq > 0) ? (uint32_t)(1e6 / updateFrq) : callPeriod;
+  const size_t loops = 200000;
+  uint32_t period = 40000;
+  auto start = std::chrono::steady_clock::now();
+  uint64_t cycles = cycleCounter();
+  for(size_t i = 0; i < loops; i++)
+  {
+    if(TachometerOptical_Core::updateDue(config, dt))
+    {
+      float alpha = TachometerOptical_Core::filterAlpha(config, dt);
+      TachometerOptical_Core::updateChannel(config, channel, alpha, period + (i & 7), 1000, false, dt);
+    }
+  }
+  cycles = cycleCounter() - cycles;
+  auto stop = std::chrono::steady_clock::now();
+  // A volatile store keeps the result alive, so the loop is not removed by the optimizer. It is local, because benchmarks run in parallel.
+  volatile float sink = channel.RPM;
+  (void)sink;
+  result.nsPerUpdate = std::chrono::duration<double, std::nano>(stop - start).count() / loops;
+  if(cycles > 0)
+  {
+    result.cyclesPerUpdate = (double)cycles / loops;
+  }
+
+  return result;
+}
+
+static std::vector<float> parseList(const char *text)
+{
+  std::vector<float> values;
+  const char *p = text;
+  while(*p != 0)
+  {
+    char *end;
+    values.push_back(std::strtof(p, &end));
+    p = (*end == ',') ? end + 1 : end;
+    if(end == p && *p != 0) break;
+  }
+  return values;
+}
+
+static void printUsage(void)
+{
+  std::printf(
+    "Usage: TachometerBench [options] [recorded trace file]...\n"
+    "  -u <Hz,Hz,...>  update frequencies. Default: 50,100,200,500,1000\n"
+    "  -f <Hz,Hz,...>  filter frequencies. Default: 0,1,2,5,10,20\n"
+    "  -c <us>         time between update() calls of the main loop. Default: 100\n"
+    "  -p <tolerance>  pulse classifier tolerance. setPulseClassifier(). Default: 0\n"
+    "  -w <n>          half window of the recorded reference speed. [periods] Default: 5\n"
+    "  -s <seed>       random seed of synthetic scenarios. Default: 1\n"
+    "  -n              no synthetic scenarios\n"
+    "  -j <n>          number of threads. Default: all cores\n");
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<float> updateFrqs = {50, 100, 200, 500, 1000};
+  std::vector<float> filterFrqs = {0, 1, 2, 5, 10, 20};
+  uint32_t callPeriod = 100;
+  float tolerance = 0;
+  unsigned halfWindow = 5;
+  uint32_t seed = 1;
+  bool synthetic = true;
+  unsigned threads = 0;
+  std::vector<std::string> files;
+
+  for(int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    bool hasValue = (i + 1 < argc);
+
+    if( (arg == "-u") && hasValue )       updateFrqs = parseList(argv[++i]);
+    else if( (arg == "-f") && hasValue )  filterFrqs = parseList(argv[++i]);
+    else if( (arg == "-c") && hasValue )  callPeriod = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+    else if( (arg == "-p") && hasValue )  tolerance = std::strtof(argv[++i], nullptr);
+    else if( (arg == "-w") && hasValue )  halfWindow = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+    else if( (arg == "-s") && hasValue )  seed = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+    else if( (arg == "-j") && hasValue )  threads = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+    else if(arg == "-n")                  synthetic = false;
+    else if( (arg.size() > 1) && (arg[0] == '-') )
+    {
+      printUsage();
+      return 1;
+    }
+    else files.push_back(arg);
+  }
+
+  std::vector<ScenarioStructure> scenarios;
+  if(synthetic)
+  {
+    scenarios = syntheticScenarios(seed);
+  }
+  for(const std::string &file : files)
+  {
+    std::vector<ScenarioStructure> recorded = recordedScenarios(file, halfWindow);
+    scenarios.insert(scenarios.end(), recorded.begin(), recorded.end());
+  }
+
+  if(scenarios.empty() || updateFrqs.empty() || filterFrqs.empty())
+  {
+    printUsage();
+    return 1;
+  }
+
+  std::vector<ResultStructure> results(scenarios.size() * updateFrqs.size() * filterFrqs.size());
+  {
+    WorkStealingPool pool(threads);
+    TaskGroup group(pool);
+    size_t index = 0;
+    for(const ScenarioStructure &scenario : scenarios)
+    {
+      for(float updateFrq : updateFrqs)
+      {
+        for(float filterFrq : filterFrqs)
+        {
+          group.run([&, index, updateFrq, filterFrq]()
+          {
+            results[index] = runBenchmark(scenario, updateFrq, filterFrq, callPeriod, tolerance);
+          });
+          index++;
+        }
+      }
+    }
+    group.wait();
+  }
+
+  std::printf("scenario,update_hz,filter_hz,delay50_ms,settling_ms,rms_error_rpm,max_error_rpm,ns_per_update,cycles_per_update\n");
+  for(const ResultStructure &r : results)
+  {
+    std::printf("%s,%g,%g,%.3f,%.3f,%.3f,%.3f,%.2f,%.1f\n", r.scenario.c_str(), r.updateFrq, r.filterFrq,
+                r.delay, r.settling, r.rmsError, r.maxError, r.nsPerUpdate, r.cyclesPerUpdate);
+  }
+
+  return 0;
+}
@@ -0,0 +1,141 @@
+// ##################################################################
+// Tool information:
+/*
+TelemetryDecoder - Decoder for TachometerTelemetry binary UART captures.
+It finds the frames in the byte stream, checks their CRC and writes the edge timestamps as a trace file,
+so the captures can be used with TachometerAnalyzer and TachometerBench.
+For more information read tools/README.md file.
+*/
+// ###################################################################
+// Include libraaries:
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "TachometerTelemetryFrame.h"
+#include "TraceFile.h"
+
+using namespace TachometerTelemetry_Frame;
+
+// ###################################################################################
+//  General definitions:
+
+/**
+  @struct ChannelStructure
+  @brief Decoder state of one channel.
+*/
+struct ChannelStructure
+{
+  /// @brief Number of decoded frames.
+  size_t frames = 0;
+
+  /// @brief Number of decoded edges.
+  size_t edges = 0;
+
+  /// @brief Number of lost frames found from sequence gaps.
+  size_t lostFrames = 0;
+
+  /// @brief Sequence number of the next frame.
+  uint16_t sequence = 0;
+
+  /// @brief Last edge time in 32 bits and its 64-bit unwrapped value. [us]
+  uint32_t last = 0;
+  uint64_t time = 0;
+};
+
+static void printUsage(void)
+{
+  std::printf(
+    "Usage: TelemetryDecoder <capture file> [trace file]\n"
+    "  The trace file is written to stdout if it is not given. Statistics are written to stderr.\n");
+}
+
+int main(int argc, char **argv)
+{
+  if( (argc < 2) || (argc > 3) )
+  {
+    printUsage();
+    return 1;
+  }
+
+  std::string data;
+  if(TraceFile::readFile(argv[1], data) == false)
+  {
+    std::fprintf(stderr, "Error TelemetryDecoder: can not read %s\n", argv[1]);
+    return 1;
+  }
+
+  FILE *out = (argc == 3) ? std::fopen(argv[2], "w") : stdout;
+  if(out == nullptr)
+  {
+    std::fprintf(stderr, "Error TelemetryDecoder: can not write %s\n", argv[2]);
+    return 1;
+  }
+
+  std::fprintf(out, "# channel timestamp_us\n");
+
+  ChannelStructure channels[3];
+  size_t badFrames = 0;
+  size_t skippedBytes = 0;
+  size_t offset = 0;
+
+  while(offset + sizeof(FrameStructure) <= data.size())
+  {
+    FrameStructure frame;
+    std::memcpy(&frame, data.data() + offset, sizeof(frame));
+
+    if(checkFrame(frame) == false)
+    {
+      // Resync on the next start word.
+      if(frame.sync == _SYNC)
+      {
+        badFrames++;
+      }
+      offset++;
+      skippedBytes++;
+      continue;
+    }
+    offset += sizeof(FrameStructure);
+
+    ChannelStructure &channel = channels[frame.channel - 1];
+
+    if(channel.frames > 0)
+    {
+      channel.lostFrames += (uint16_t)(frame.sequence - channel.sequence);
+    }
+    channel.sequence = frame.sequence + 1;
+    channel.frames++;
+
+    // Timestamps are 32-bit micros() values. They are unwrapped to 64 bits per channel.
+    uint32_t t = frame.timestamp;
+    for(uint8_t i = 0; i < frame.count; i++)
+    {
+      if(i > 0)
+      {
+        t += frame.delta[i - 1];
+      }
+      channel.time += (channel.edges > 0) ? (uint32_t)(t - channel.last) : t;
+      channel.last = t;
+      channel.edges++;
+      std::fprintf(out, "%u %llu\n", (unsigned)frame.channel, (unsigned long long)channel.time);
+    }
+  }
+
+  if(out != stdout)
+  {
+    std::fclose(out);
+  }
+
+  std::fprintf(stderr, "channel,frames,edges,lost_frames\n");
+  for(unsigned i = 0; i < 3; i++)
+  {
+    if(channels[i].frames > 0)
+    {
+      std::fprintf(stderr, "%u,%zu,%zu,%zu\n", i + 1, channels[i].frames, channels[i].edges, channels[i].lostFrames);
+    }
+  }
+  std::fprintf(stderr, "bad_crc_frames,%zu\nskipped_bytes,%zu\n", badFrames, skippedBytes);
+
+  return 0;
+}
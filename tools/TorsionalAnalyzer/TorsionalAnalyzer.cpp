@@ -0,0 +1,562 @@
+// ##################################################################
+// Tool information:
+/*
+TorsionalAnalyzer - Speed fluctuation (torsional vibration) order spectrum of TachometerOptical edge trace files.
+It calculates the angular velocity of every mark with the firmware pulse classifier and missing-tooth decoder
+(TachometerOpticalCore.h), resamples it in the angle domain and averages FFT spectra per order.
+Files and channels are processed in parallel on all cores.
+For more information read tools/README.md file.
+*/
+// ###################################################################
+// Include libraaries:
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "TraceFile.h"
+#include "TachometerOpticalCore.h"
+#include "WorkStealingPool.h"
+
+namespace fs = std::filesystem;
+
+// ###################################################################################
+//  General definitions:
+
+/// @brief Minimum trace chunk size parsed by one task. [bytes]
+#define CHUNK_SIZE      (4u << 20)
+
+/**
+  @struct OptionsStructure
+  @brief Command line options.
+*/
+struct OptionsStructure
+{
+  unsigned marks = 1;
+  bool toothDecoder = false;
+  float tolerance = 0;
+  unsigned samples = 0;
+  unsigned revolutions = 8;
+  unsigned threads = 0;
+  std::string outputDir;
+  std::vector<std::string> inputs;
+};
+
+/**
+  @struct SummaryStructure
+  @brief Summary of one channel of one file.
+*/
+struct SummaryStructure
+{
+  std::string file;
+  unsigned channel = 0;
+  unsigned pulsesPerRevolution = 0;
+  size_t revolutions = 0;
+  size_t blocks = 0;
+  double meanRPM = 0;
+  double peakOrder = 0;
+  double peakRPM = 0;
+  size_t errors = 0;
+};
+
+/**
+  @class FFT
+  @brief Radix-2 complex FFT with precomputed twiddles and bit reversal.
+  Real and imaginary parts are in separate arrays and the butterflies of a stage are independent, so the inner loop is vectorised by the compiler.
+*/
+class FFT
+{
+  public:
+
+    /**
+     * @brief Prepare the tables of a size. It must be a power of 2.
+     */
+    explicit FFT(size_t size) : _size(size), _cos(size / 2), _sin(size / 2), _reverse(size)
+    {
+      for(size_t i = 0; i < size / 2; i++)
+      {
+        _cos[i] = std::cos(TachometerOptical_Core::_2PI * i / size);
+        _sin[i] = -std::sin(TachometerOptical_Core::_2PI * i / size);
+      }
+
+      unsigned bits = 0;
+      while( ((size_t)1 << bits) < size )
+      {
+        bits++;
+      }
+
+      for(size_t i = 0; i < size; i++)
+      {
+        size_t r = 0;
+        for(unsigned b = 0; b < bits; b++)
+        {
+          r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        _reverse[i] = r;
+      }
+    }
+
+    /**
+     * @brief In-place forward transform.
+     */
+    void run(std::vector<double> &re, std::vector<double> &im) const
+    {
+      for(size_t i = 0; i < _size; i++)
+      {
+        if(i < _reverse[i])
+        {
+          std::swap(re[i], re[_reverse[i]]);
+          std::swap(im[i], im[_reverse[i]]);
+        }
+      }
+
+      for(size_t half = 1; half < _size; half <<= 1)
+      {
+        size_t step = _size / (2 * half);
+
+        for(size_t start = 0; start < _size; start += 2 * half)
+        {
+          double *aRe = &re[start];
+          double *aIm = &im[start];
+          double *bRe = &re[start + half];
+          double *bIm = &im[start + half];
+
+          for(size_t k = 0; k < half; k++)
+          {
+            double wRe = _cos[k * step];
+            double wIm = _sin[k * step];
+            double tRe = bRe[k] * wRe - bIm[k] * wIm;
+            double tIm = bRe[k] * wIm + bIm[k] * wRe;
+            bRe[k] = aRe[k] - tRe;
+            bIm[k] = aIm[k] - tIm;
+            aRe[k] += tRe;
+            aIm[k] += tIm;
+          }
+        }
+      }
+    }
+
+  private:
+
+    size_t _size;
+    std::vector<double> _cos;
+    std::vector<double> _sin;
+    std::vector<size_t> _reverse;
+};
+
+static void printUsage(void)
+{
+  std::printf(
+    "Usage: TorsionalAnalyzer [options] <trace file or directory>...\n"
+    "  -m <marks>  marks per revolution of a uniform wheel. Default: 1\n"
+    "  -t          missing-tooth wheel. setToothDecoder(). The marks are detected.\n"
+    "  -p <tolerance>  pulse classifier tolerance. setPulseClassifier(). Default: 0\n"
+    "  -n <n>      angle samples per revolution. A power of 2. Default: marks rounded up to a power of 2\n"
+    "  -r <n>      revolutions per FFT block. A power of 2. Default: 8\n"
+    "  -j <n>      number of threads. Default: all cores\n"
+    "  -o <dir>    output directory for <file>.ch<N>.orders.csv spectra. Default: no spectrum output\n");
+}
+
+static bool isPowerOf2(unsigned value)
+{
+  return (value > 0) && ((value & (value - 1)) == 0);
+}
+
+static bool parseOptions(int argc, char **argv, OptionsStructure &options)
+{
+  for(int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    bool hasValue = (i + 1 < argc);
+
+    if( (arg == "-m") && hasValue )       options.marks = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+    else if(arg == "-t")                  options.toothDecoder = true;
+    else if( (arg == "-p") && hasValue )  options.tolerance = std::strtof(argv[++i], nullptr);
+    else if( (arg == "-n") && hasValue )  options.samples = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+    else if( (arg == "-r") && hasValue )  options.revolutions = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+    else if( (arg == "-j") && hasValue )  options.threads = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+    else if( (arg == "-o") && hasValue )  options.outputDir = argv[++i];
+    else if( (arg.size() > 1) && (arg[0] == '-') ) return false;
+    else options.inputs.push_back(arg);
+  }
+
+  return !options.inputs.empty() && (options.marks >= 1) && (options.marks <= 0xFFFF) && isPowerOf2(options.revolutions) &&
+         ( (options.samples == 0) || isPowerOf2(options.samples) ) && (options.tolerance >= 0) && (options.tolerance < 0.33f);
+}
+
+/**
+ * @brief Split the edges of one channel into revolutions of per-mark speeds, like the firmware edge interrupt.
+ * @param pulsesPerRevolution is the marks per revolution. It is the detected value in missing-tooth mode.
+ * @return Runs of consecutive revolutions. Each revolution has pulsesPerRevolution mark speeds. [RPM]
+ */
+static std::vector<std::vector<std::vector<float>>> markSpeeds(const OptionsStructure &options, const std::vector<uint64_t> &edges, unsigned &pulsesPerRevolution)
+{
+  std::vector<std::vector<std::vector<float>>> runs(1);
+  std::vector<float> revolution;
+
+  TachometerOptical_Core::PulseClassifierStructure classifier = TachometerOptical_Core::makePulseClassifier(options.tolerance, 2);
+  TachometerOptical_Core::ToothDecoderStructure decoder = {};
+  TachometerOptical_Core::resetToothDecoder(decoder);
+
+  pulsesPerRevolution = options.toothDecoder ? 0 : options.marks;
+  uint32_t prevPeriod = 0;
+
+  // A gap in the stream: the revolutions after it start a new run.
+  auto restart = [&]()
+  {
+    revolution.clear();
+    if(!runs.back().empty())
+    {
+      runs.emplace_back();
+    }
+  };
+
+  for(size_t i = 1; i < edges.size(); i++)
+  {
+    uint32_t period = (uint32_t)(edges[i] - edges[i - 1]);
+
+    if(period > TachometerOptical_Core::_EDGE_TIMEOUT)
+    {
+      // The firmware warm-up restarts after an edge timeout.
+      classifier = TachometerOptical_Core::makePulseClassifier(options.tolerance, 2);
+      TachometerOptical_Core::resetToothDecoder(decoder);
+      prevPeriod = 0;
+      restart();
+      continue;
+    }
+
+    uint8_t pulses = 1;
+    uint32_t markPeriod = period;
+
+    if(options.toothDecoder)
+    {
+      TachometerOptical_Core::ToothEvent event = TachometerOptical_Core::decodeTooth(decoder, period, prevPeriod, pulses);
+      prevPeriod = period;
+
+      if(event == TachometerOptical_Core::ToothEvent::UNLOCKED)
+      {
+        restart();
+        continue;
+      }
+
+      if(decoder.pulsesPerRevolution != pulsesPerRevolution)
+      {
+        pulsesPerRevolution = decoder.pulsesPerRevolution;
+        runs.assign(1, {});
+        revolution.clear();
+      }
+
+      // The gap period has pulses tooth periods.
+      markPeriod = period / pulses;
+      revolution.insert(revolution.end(), pulses, (float)(TachometerOptical_Core::_RPM_US / ((double)markPeriod * pulsesPerRevolution)));
+
+      // The index is the first tooth after the gap, so the gap ends the revolution.
+      if(event == TachometerOptical_Core::ToothEvent::INDEX)
+      {
+        if(revolution.size() == pulsesPerRevolution)
+        {
+          runs.back().push_back(revolution);
+        }
+        revolution.clear();
+      }
+      continue;
+    }
+
+    if(options.tolerance > 0)
+    {
+      TachometerOptical_Core::classifyPulse(classifier, period, markPeriod, pulses);
+    }
+
+    for(uint8_t p = 0; p < pulses; p++)
+    {
+      revolution.push_back((float)(TachometerOptical_Core::_RPM_US / ((double)markPeriod * pulsesPerRevolution)));
+
+      if(revolution.size() == pulsesPerRevolution)
+      {
+        runs.back().push_back(revolution);
+        revolution.clear();
+      }
+    }
+  }
+
+  return runs;
+}
+
+/**
+ * @brief Analyze one channel, write its order spectrum and return its summary.
+ */
+static SummaryStructure analyzeChannel(const OptionsStructure &options, const std::string &file, unsigned channel, const std::vector<uint64_t> &edges)
+{
+  SummaryStructure summary;
+  summary.file = file;
+  summary.channel = channel;
+
+  unsigned ppr = 0;
+  std::vector<std::vector<std::vector<float>>> runs = markSpeeds(options, edges, ppr);
+  summary.pulsesPerRevolution = ppr;
+
+  if(ppr == 0)
+  {
+    return summary;
+  }
+
+  unsigned samples = options.samples;
+  if(samples == 0)
+  {
+    samples = 1;
+    while(samples < ppr)
+    {
+      samples <<= 1;
+    }
+  }
+
+  size_t size = (size_t)samples * options.revolutions;
+  FFT fft(size);
+
+  std::vector<double> window(size);
+  double windowSum = 0;
+  for(size_t i = 0; i < size; i++)
+  {
+    window[i] = 0.5 - 0.5 * std::cos(TachometerOptical_Core::_2PI * i / size);
+    windowSum += window[i];
+  }
+
+  std::vector<double> power(size / 2 + 1, 0.0);
+  std::vector<double> re(size), im(size);
+  double sumRPM = 0;
+  size_t countRPM = 0;
+
+  for(const std::vector<std::vector<float>> &run : runs)
+  {
+    summary.revolutions += run.size();
+
+    // Blocks of consecutive revolutions. The last partial block is not used.
+    for(size_t first = 0; first + options.revolutions <= run.size(); first += options.revolutions)
+    {
+      double mean = 0;
+      for(size_t r = 0; r < options.revolutions; r++)
+      {
+        const std::vector<float> &marks = run[first + r];
+        for(unsigned j = 0; j < samples; j++)
+        {
+          // Mark speeds are at the middle of their mark intervals. Linear interpolation in the angle domain.
+          double position = ((j + 0.5) * ppr) / samples - 0.5;
+          position = std::min(std::max(position, 0.0), (double)ppr - 1);
+          unsigned low = (unsigned)position;
+          unsigned high = std::min(low + 1, ppr - 1);
+          double fraction = position - low;
+          double value = marks[low] + fraction * (marks[high] - marks[low]);
+          re[r * samples + j] = value;
+          mean += value;
+        }
+      }
+      mean /= size;
+      sumRPM += mean;
+      countRPM++;
+
+      for(size_t i = 0; i < size; i++)
+      {
+        re[i] = (re[i] - mean) * window[i];
+        im[i] = 0;
+      }
+
+      fft.run(re, im);
+
+      for(size_t k = 0; k <= size / 2; k++)
+      {
+        power[k] += re[k] * re[k] + im[k] * im[k];
+      }
+      summary.blocks++;
+    }
+  }
+
+  if(summary.blocks == 0)
+  {
+    return summary;
+  }
+
+  summary.meanRPM = sumRPM / countRPM;
+
+  // Orders above half of the marks per revolution are aliased in the mark sampling.
+  size_t maxBin = std::min(size / 2, (size_t)ppr * options.revolutions / 2);
+  std::vector<double> amplitude(maxBin + 1);
+  for(size_t k = 0; k <= maxBin; k++)
+  {
+    // Single-sided peak amplitude of the windowed spectrum. [RPM]
+    amplitude[k] = 2.0 * std::sqrt(power[k] / summary.blocks) / windowSum;
+  }
+
+  // Bin 0 and its window leakage neighbour are the mean speed.
+  for(size_t k = 2; k <= maxBin; k++)
+  {
+    if(amplitude[k] > summary.peakRPM)
+    {
+      summary.peakRPM = amplitude[k];
+      summary.peakOrder = (double)k / options.revolutions;
+    }
+  }
+
+  if(!options.outputDir.empty())
+  {
+    std::string path = (fs::path(options.outputDir) / (fs::path(file).stem().string() + ".ch" + std::to_string(channel) + ".orders.csv")).string();
+    FILE *out = std::fopen(path.c_str(), "w");
+    if(out != nullptr)
+    {
+      std::fprintf(out, "order,amplitude_rpm\n");
+      for(size_t k = 1; k <= maxBin; k++)
+      {
+        std::fprintf(out, "%.6g,%.9g\n", (double)k / options.revolutions, amplitude[k]);
+      }
+      std::fclose(out);
+    }
+    else
+    {
+      std::fprintf(stderr, "Error TorsionalAnalyzer: can not write %s\n", path.c_str());
+    }
+  }
+
+  return summary;
+}
+
+/**
+ * @brief Parse one trace file in parallel chunks and analyze its channels in parallel.
+ */
+static void analyzeFile(WorkStealingPool &pool, const OptionsStructure &options, const std::string &file, std::mutex &resultsMutex, std::vector<SummaryStructure> &results)
+{
+  std::string data;
+  if(TraceFile::readFile(file, data) == false)
+  {
+    std::fprintf(stderr, "Error TorsionalAnalyzer: can not read %s\n", file.c_str());
+    return;
+  }
+
+  std::vector<size_t> offsets = TraceFile::splitLines(data, CHUNK_SIZE);
+  std::vector<std::vector<TraceFile::EdgeStructure>> chunks(offsets.size() - 1);
+  std::vector<size_t> chunkErrors(chunks.size(), 0);
+
+  {
+    TaskGroup group(pool);
+    for(size_t i = 0; i < chunks.size(); i++)
+    {
+      group.run([&, i]()
+      {
+        chunkErrors[i] = TraceFile::parse(data.data() + offsets[i], data.data() + offsets[i + 1], chunks[i]);
+      });
+    }
+    group.wait();
+  }
+
+  // Chunks are joined in file order, so the edge order of each channel is kept.
+  std::map<unsigned, std::vector<uint64_t>> channels;
+  size_t errors = 0;
+  for(size_t i = 0; i < chunks.size(); i++)
+  {
+    errors += chunkErrors[i];
+    for(const TraceFile::EdgeStructure &edge : chunks[i])
+    {
+      channels[edge.channel].push_back(edge.timestamp);
+    }
+    std::vector<TraceFile::EdgeStructure>().swap(chunks[i]);
+  }
+
+  std::vector<SummaryStructure> summaries(channels.size());
+  {
+    TaskGroup group(pool);
+    size_t i = 0;
+    for(const auto &channel : channels)
+    {
+      group.run([&, i]()
+      {
+        summaries[i] = analyzeChannel(options, file, channel.first, channel.second);
+      });
+      i++;
+    }
+    group.wait();
+  }
+
+  std::lock_guard<std::mutex> lock(resultsMutex);
+  for(SummaryStructure &summary : summaries)
+  {
+    summary.errors = errors;
+    results.push_back(summary);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  OptionsStructure options;
+  if(parseOptions(argc, argv, options) == false)
+  {
+    printUsage();
+    return 1;
+  }
+
+  std::vector<std::string> files;
+  for(const std::string &input : options.inputs)
+  {
+    if(fs::is_directory(input))
+    {
+      for(const fs::directory_entry &entry : fs::directory_iterator(input))
+      {
+        if(entry.is_regular_file())
+        {
+          files.push_back(entry.path().string());
+        }
+      }
+    }
+    else
+    {
+      files.push_back(input);
+    }
+  }
+  std::sort(files.begin(), files.end());
+
+  std::error_code error;
+  if(!options.outputDir.empty())
+  {
+    fs::create_directories(options.outputDir, error);
+  }
+  if(error)
+  {
+    std::fprintf(stderr, "Error TorsionalAnalyzer: can not create %s\n", options.outputDir.c_str());
+    return 1;
+  }
+
+  std::mutex resultsMutex;
+  std::vector<SummaryStructure> results;
+
+  {
+    WorkStealingPool pool(options.threads);
+    TaskGroup group(pool);
+    for(const std::string &file : files)
+    {
+      group.run([&, file]()
+      {
+        analyzeFile(pool, options, file, resultsMutex, results);
+      });
+    }
+    group.wait();
+  }
+
+  std::sort(results.begin(), results.end(), [](const SummaryStructure &a, const SummaryStructure &b)
+  {
+    return (a.file != b.file) ? (a.file < b.file) : (a.channel < b.channel);
+  });
+
+  std::printf("file,channel,pulses_per_revolution,revolutions,blocks,rpm_mean,peak_order,peak_rpm,bad_lines\n");
+  for(const SummaryStructure &summary : results)
+  {
+    std::printf("%s,%u,%u,%zu,%zu,%.9g,%.6g,%.9g,%zu\n", summary.file.c_str(), summary.channel, summary.pulsesPerRevolution, summary.revolutions,
+                summary.blocks, summary.meanRPM, summary.peakOrder, summary.peakRPM, summary.errors);
+  }
+
+  return 0;
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+// ##################################################################
+// Library information:
+/*
+TachometerSim - Host replay of the TachometerOptical firmware for one channel.
+The edge interrupt and update() are replayed with the same TachometerOpticalCore.h code and 32-bit time math as the firmware,
+so the results are bit-identical for the same edge times and update() call times.
+*/
+// ###################################################################
+// Include libraaries:
+
+#include <cstdint>
+#include <vector>
+
+#include "TachometerOpticalCore.h"
+
+// ##################################################################################
+// TachometerSim class
+
+/**
+  @class TachometerSim
+  @brief Firmware replay of one TachometerOptical channel.
+*/
+class TachometerSim
+{
+  public:
+
+    /**
+      @struct SampleStructure
+      @brief Channel values after one update() call that passed the update frequency check.
+    */
+    struct SampleStructure
+    {
+      /// @brief update() time. [us]
+      uint64_t timestamp;
+
+      /// @brief Raw input RPM value. [RPM]
+      float rawRPM;
+
+      /// @brief Filtered RPM value. [RPM]
+      float RPM;
+    };
+
+    /**
+     * @param config is the firmware filter configuration.
+     * @param callPeriod is the time between update() calls of the firmware main loop. [us]
+     */
+    TachometerSim(const TachometerOptical_Core::FilterConfigStructure &config, uint32_t callPeriod)
+    {
+      _config = config;
+      _callPeriod = (callPeriod > 0) ? callPeriod : 1;
+      _adaptiveFilter = TachometerOptical_Core::makeAdaptiveFilter(0, 1);
+      _classifier = TachometerOptical_Core::makePulseClassifier(0, 0);
+      reset();
+    }
+
+    /**
+     * @brief Set the speed-proportional low-pass filter like TachometerOptical::setAdaptiveFilter().
+     * @param revolutions is the filter time constant. [revolutions] A value of 0 means it is disabled.
+     */
+    void setAdaptiveFilter(float revolutions)
+    {
+      _adaptiveFilter = TachometerOptical_Core::makeAdaptiveFilter(revolutions, 1);
+    }
+
+    /**
+     * @brief Set the missing and extra pulse classifier like TachometerOptical::setPulseClassifier().
+     * @param tolerance is the period tolerance. A value of 0 means it is disabled.
+     */
+    void setPulseClassifier(float tolerance, uint8_t maxMissing)
+    {
+      _classifier = TachometerOptical_Core::makePulseClassifier(tolerance, maxMissing);
+    }
+
+    /// @brief Return the pulse classifier state and counters.
+    const TachometerOptical_Core::PulseClassifierStructure &getPulseClassifier(void) const {return _classifier;};
+
+    /// @brief Reset the channel state like a firmware reset.
+    void reset(void)
+    {
+      _channel.rawRPM = 0;
+      _channel.RPM = 0;
+      _period = 0;
+      _startPeriod = 0;
+      _T = 0;
+      _nextCall = 0;
+      _warmup = TachometerOptical_Core::WarmupState::WAIT_FIRST_EDGE;
+      _edgeCount = 0;
+      _updateEdgeCount = 0;
+      _rawEdgeTime = 0;
+      _classifier.expected = 0;
+      _classifier.fragment = 0;
+      _classifier.last = TachometerOptical_Core::PulseClass::NORMAL;
+      _classifier.missing = 0;
+      _classifier.extra = 0;
+    }
+
+    /**
+     * @brief Edge interrupt replay.
+     * @param timestamp is the edge time. [us]
+     */
+    void edge(uint64_t timestamp)
+    {
+      uint32_t tNow = (uint32_t)timestamp;
+      uint32_t period = tNow - _rawEdgeTime;
+      uint8_t pulses = 1;
+      _rawEdgeTime = tNow;
+
+      if( (_classifier.tolerance == 0) || (_warmup == TachometerOptical_Core::WarmupState::WAIT_FIRST_EDGE) )
+      {
+        _classifier.expected = 0;
+        _classifier.fragment = 0;
+        _classifier.last = TachometerOptical_Core::PulseClass::NORMAL;
+        period = tNow - _startPeriod;
+      }
+      else
+      {
+        TachometerOptical_Core::classifyPulse(_classifier, period, period, pulses);
+        if(pulses == 0)
+        {
+          return;
+        }
+      }
+
+      _startPeriod = tNow;
+      _edgeCount += pulses;
+
+      if(TachometerOptical_Core::warmupEdge(_warmup))
+      {
+        _period = period;
+      }
+    }
+
+    /**
+     * @brief update() replay.
+     * @param timestamp is the update() call time. [us]
+     * @param sample is the output if the update frequency check passed.
+     * @return true if the channel values are updated.
+     */
+    bool update(uint64_t timestamp, SampleStructure &sample)
+    {
+      uint32_t t = (uint32_t)timestamp;
+      uint32_t dt = t - _T;
+
+      if(TachometerOptical_Core::updateDue(_config, dt) == false)
+      {
+        return false;
+      }
+
+      float alpha = TachometerOptical_Core::filterAlpha(_config, dt);
+      uint32_t newPulses = _edgeCount - _updateEdgeCount;
+      _updateEdgeCount += newPulses;
+      if(_adaptiveFilter.revolutions > 0)
+      {
+        alpha = TachometerOptical_Core::adaptiveAlpha(_adaptiveFilter, newPulses, t - _startPeriod);
+      }
+      TachometerOptical_Core::updateChannelWarmup(_config, _channel, _warmup, alpha, _period, t - _startPeriod, false, dt);
+      _T = t;
+
+      sample.timestamp = timestamp;
+      sample.rawRPM = _channel.rawRPM;
+      sample.RPM = _channel.RPM;
+
+      return true;
+    }
+
+    /**
+     * @brief Replay an edge stream with update() called every callPeriod.
+     * @param edges is the edge times in order. [us]
+     * @param samples is the output. Samples are appended.
+     * @param end is the time of the last update() call. A value of 0 means the last edge time.
+     */
+    void run(const std::vector<uint64_t> &edges, std::vector<SampleStructure> &samples, uint64_t end = 0)
+    {
+      if(edges.empty())
+      {
+        return;
+      }
+      if(end == 0)
+      {
+        end = edges.back();
+      }
+      if(_nextCall == 0)
+      {
+        _nextCall = edges.front() - (edges.front() % _callPeriod);
+      }
+
+      size_t index = 0;
+      SampleStructure sample;
+
+      while(_nextCall <= end)
+      {
+        // Edges up to the call time are served by the edge interrupt before update() runs.
+        while( (index < edges.size()) && (edges[index] <= _nextCall) )
+        {
+          edge(edges[index++]);
+        }
+
+        if(update(_nextCall, sample))
+        {
+          samples.push_back(sample);
+        }
+
+        _nextCall += _callPeriod;
+      }
+    }
+
+    /// @brief Return the channel values.
+    const TachometerOptical_Core::ChannelStructure &getChannel(void) const {return _channel;};
+
+  private:
+
+    TachometerOptical_Core::FilterConfigStructure _config;
+    TachometerOptical_Core::ChannelStructure _channel;
+
+    /// @brief Time between update() calls. [us]
+    uint32_t _callPeriod;
+
+    /// @brief Next update() call time. [us]
+    uint64_t _nextCall;
+
+    /// @brief Same names and types as the firmware.
+    uint32_t _period;
+    uint32_t _startPeriod;
+    uint32_t _T;
+    TachometerOptical_Core::WarmupState _warmup;
+    uint32_t _edgeCount;
+    uint32_t _updateEdgeCount;
+    TachometerOptical_Core::AdaptiveFilterStructure _adaptiveFilter;
+    TachometerOptical_Core::PulseClassifierStructure _classifier;
+    uint32_t _rawEdgeTime;
+};
@@ -0,0 +1,154 @@
+#pragma once
+
+// ##################################################################
+// Library information:
+/*
+TraceFile - Reader for TachometerOptical edge trace files.
+
+Trace file format:
+  One edge per line: <channel> <timestamp>
+  - channel is the channel number. (1, 2, 3, ...)
+  - timestamp is the edge time. [us] It may be any unsigned 64-bit value and wraps like the firmware micros() only in 32-bit math.
+  - Fields are separated by spaces, tabs or a comma.
+  - Empty lines and lines that start with '#' are ignored.
+*/
+// ###################################################################
+// Include libraaries:
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// ###################################################################################
+//  General function declarations:
+
+namespace TraceFile
+{
+  /**
+    @struct EdgeStructure
+    @brief One edge of a trace file.
+  */
+  struct EdgeStructure
+  {
+    /// @brief Channel number.
+    uint8_t channel;
+
+    /// @brief Edge time. [us]
+    uint64_t timestamp;
+  };
+
+  /**
+   * @brief Read a whole file in memory.
+   * @return true if successful.
+   */
+  inline bool readFile(const std::string &path, std::string &data)
+  {
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if(file == nullptr)
+    {
+      return false;
+    }
+
+    std::fseek(file, 0, SEEK_END);
+    long size = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+
+    data.resize((size > 0) ? (size_t)size : 0);
+    size_t count = data.empty() ? 0 : std::fread(&data[0], 1, data.size(), file);
+    std::fclose(file);
+
+    return count == data.size();
+  }
+
+  /**
+   * @brief Split a buffer in chunks that start at line beginnings.
+   * @param chunkSize is the minimum chunk size. [bytes]
+   * @return Offsets of chunk beginnings. The last value is the buffer size.
+   */
+  inline std::vector<size_t> splitLines(const std::string &data, size_t chunkSize)
+  {
+    std::vector<size_t> offsets(1, 0);
+
+    size_t position = chunkSize;
+    while(position < data.size())
+    {
+      size_t end = data.find('\n', position);
+      if(end == std::string::npos)
+      {
+        break;
+      }
+      offsets.push_back(end + 1);
+      position = end + 1 + chunkSize;
+    }
+    if(offsets.back() != data.size())
+    {
+      offsets.push_back(data.size());
+    }
+
+    return offsets;
+  }
+
+  /**
+   * @brief Parse the lines in [begin, end) of a buffer.
+   * @param edges is the output. Parsed edges are appended in file order.
+   * @return Number of malformed lines.
+   */
+  inline size_t parse(const char *begin, const char *end, std::vector<EdgeStructure> &edges)
+  {
+    size_t errors = 0;
+    const char *p = begin;
+
+    while(p < end)
+    {
+      while( (p < end) && ((*p == ' ') || (*p == '\t') || (*p == '\r')) )
+      {
+        p++;
+      }
+
+      if( (p < end) && (*p != '\n') && (*p != '#') )
+      {
+        uint64_t fields[2] = {0, 0};
+        int count = 0;
+
+        while( (p < end) && (*p != '\n') && (count < 2) )
+        {
+          if( (*p < '0') || (*p > '9') )
+          {
+            break;
+          }
+          while( (p < end) && (*p >= '0') && (*p <= '9') )
+          {
+            fields[count] = fields[count] * 10 + (uint64_t)(*p - '0');
+            p++;
+          }
+          count++;
+          while( (p < end) && ((*p == ' ') || (*p == '\t') || (*p == ',') || (*p == '\r')) )
+          {
+            p++;
+          }
+        }
+
+        if( (count == 2) && (fields[0] > 0) && (fields[0] <= 255) )
+        {
+          EdgeStructure edge;
+          edge.channel = (uint8_t)fields[0];
+          edge.timestamp = fields[1];
+          edges.push_back(edge);
+        }
+        else
+        {
+          errors++;
+        }
+      }
+
+      while( (p < end) && (*p != '\n') )
+      {
+        p++;
+      }
+      p++;
+    }
+
+    return errors;
+  }
+}
@@ -0,0 +1,245 @@
+#pragma once
+
+// ##################################################################
+// Library information:
+/*
+WorkStealingPool - Host side thread pool for TachometerOptical tools.
+Each worker has its own task queue. Workers pop their own newest task and steal the oldest task of other workers when idle.
+Threads that wait for a TaskGroup run pending tasks instead of blocking, so tasks can start nested groups.
+*/
+// ###################################################################
+// Include libraaries:
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ##################################################################################
+// WorkStealingPool class
+
+/**
+  @class WorkStealingPool
+  @brief Fixed size thread pool with per-worker queues and work stealing.
+*/
+class WorkStealingPool
+{
+  public:
+
+    /// @brief Task type.
+    typedef std::function<void()> Task;
+
+    /**
+     * @brief Start the worker threads.
+     * @param threads is the number of workers. A value of 0 means one worker per hardware thread.
+     */
+    explicit WorkStealingPool(unsigned threads = 0)
+    {
+      if(threads == 0)
+      {
+        threads = std::thread::hardware_concurrency();
+      }
+      if(threads == 0)
+      {
+        threads = 1;
+      }
+
+      for(unsigned i = 0; i < threads; i++)
+      {
+        _queues.emplace_back(new QueueStructure);
+      }
+      for(unsigned i = 0; i < threads; i++)
+      {
+        _threads.emplace_back(&WorkStealingPool::_worker, this, i);
+      }
+    }
+
+    /// @brief Stop and join the worker threads. Pending tasks are finished first.
+    ~WorkStealingPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _stop = true;
+      }
+      _sleep.notify_all();
+
+      for(std::thread &thread : _threads)
+      {
+        thread.join();
+      }
+    }
+
+    /// @brief Return the number of workers.
+    unsigned size(void) const {return (unsigned)_queues.size();};
+
+    /**
+     * @brief Add a task. A worker pushes it in its own queue, other threads spread tasks over all queues.
+     */
+    void submit(Task task)
+    {
+      unsigned index = (_workerIndex() >= 0) ? (unsigned)_workerIndex() : (_next++ % size());
+
+      {
+        std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+        _queues[index]->tasks.push_back(std::move(task));
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _pending++;
+      }
+      _sleep.notify_one();
+    }
+
+    /**
+     * @brief Run one pending task in the calling thread.
+     * @return true if a task was run.
+     */
+    bool runOne(void)
+    {
+      Task task;
+      int index = _workerIndex();
+
+      if(_take((index >= 0) ? (unsigned)index : 0, task) == false)
+      {
+        return false;
+      }
+
+      task();
+      return true;
+    }
+
+  private:
+
+    /**
+      @struct QueueStructure
+      @brief Task queue of one worker.
+    */
+    struct QueueStructure
+    {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<QueueStructure>> _queues;
+    std::vector<std::thread> _threads;
+
+    std::mutex _sleepMutex;
+    std::condition_variable _sleep;
+    size_t _pending = 0;
+    bool _stop = false;
+    std::atomic<unsigned> _next{0};
+
+    /// @brief Worker index of the calling thread. -1 for threads that are not workers of a pool.
+    static int &_workerIndex(void)
+    {
+      static thread_local int index = -1;
+      return index;
+    }
+
+    /**
+     * @brief Take the newest task of the own queue, or steal the oldest task of another queue.
+     */
+    bool _take(unsigned index, Task &task)
+    {
+      {
+        std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+        if(!_queues[index]->tasks.empty())
+        {
+          task = std::move(_queues[index]->tasks.back());
+          _queues[index]->tasks.pop_back();
+          _taken();
+          return true;
+        }
+      }
+
+      for(unsigned i = 1; i < size(); i++)
+      {
+        QueueStructure &victim = *_queues[(index + i) % size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if(!victim.tasks.empty())
+        {
+          task = std::move(victim.tasks.front());
+          victim.tasks.pop_front();
+          _taken();
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    void _taken(void)
+    {
+      std::lock_guard<std::mutex> lock(_sleepMutex);
+      _pending--;
+    }
+
+    void _worker(unsigned index)
+    {
+      _workerIndex() = (int)index;
+
+      for(;;)
+      {
+        Task task;
+        if(_take(index, task))
+        {
+          task();
+          continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _sleep.wait(lock, [this]{return _stop || (_pending > 0);});
+        if(_stop && (_pending == 0))
+        {
+          return;
+        }
+      }
+    }
+};
+
+/**
+  @class TaskGroup
+  @brief Group of tasks that can be waited for. The waiting thread helps the pool.
+*/
+class TaskGroup
+{
+  public:
+
+    explicit TaskGroup(WorkStealingPool &pool) : _pool(pool), _count(0) {}
+
+    /// @brief Wait for the remaining tasks of the group.
+    ~TaskGroup() {wait();}
+
+    /// @brief Add a task to the group.
+    void run(WorkStealingPool::Task task)
+    {
+      _count++;
+      _pool.submit([this, task]()
+      {
+        task();
+        _count--;
+      });
+    }
+
+    /// @brief Wait until all tasks of the group are finished. Pending tasks of the pool are run meanwhile.
+    void wait(void)
+    {
+      while(_count > 0)
+      {
+        if(_pool.runOne() == false)
+        {
+          std::this_thread::yield();
+        }
+      }
+    }
+
+  private:
+
+    WorkStealingPool &_pool;
+    std::atomic<size_t> _count;
+};